@@ -0,0 +1,78 @@
+#ifndef ALLOCATIONAUDIT_H
+#define ALLOCATIONAUDIT_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Singleton that counts heap allocations made inside audited scopes, such as SPH::step on the
+ * stepping thread and on every worker. The count comes from replacing the global operator new,
+ * which only builds configured with NES_ALLOCATION_AUDIT do; elsewhere the scopes still mark the
+ * calling thread but nothing is counted. Once armed, an allocation inside a scope reports itself
+ * on stderr and aborts, so a run that passes has no allocation in any step after it was armed.
+ */
+class AllocationAudit {
+public:
+    /**
+     * Get the singleton instance of the AllocationAudit class.
+     * @return Reference to the AllocationAudit instance.
+     */
+    static AllocationAudit& getInstance();
+
+    AllocationAudit(const AllocationAudit&) = delete;
+    AllocationAudit& operator=(const AllocationAudit&) = delete;
+    AllocationAudit(AllocationAudit&&) = delete;
+    AllocationAudit& operator=(AllocationAudit&&) = delete;
+
+    /**
+     * Get whether this build replaces operator new and can count allocations.
+     * @return True in builds configured with NES_ALLOCATION_AUDIT.
+     */
+    [[nodiscard]] static bool available();
+
+    /**
+     * Arm or disarm the audit. Arm it after warm-up, once buffers sized by the first steps exist.
+     * @param armed Whether an allocation inside an audited scope aborts the program.
+     */
+    void arm(bool armed);
+
+    /**
+     * Get whether the audit is armed.
+     * @return True between arm(true) and arm(false).
+     */
+    [[nodiscard]] bool armed() const;
+
+    /**
+     * Get how many allocations were made inside audited scopes so far, armed or not.
+     * @return The allocation count, always zero unless available.
+     */
+    [[nodiscard]] uint64_t allocations() const;
+
+    /**
+     * Count an allocation, aborting when armed and the calling thread is inside a scope. Called by
+     * the replacement operator new; must not allocate itself.
+     */
+    void noteAllocation();
+
+private:
+    friend class AllocationScope;
+
+    constexpr AllocationAudit() = default;
+
+    std::atomic<bool> _armed { false };
+    std::atomic<uint64_t> _allocations { 0 };
+};
+
+/**
+ * Marks the calling thread as inside an audited scope for the scope's lifetime. Scopes nest.
+ */
+class AllocationScope {
+public:
+    AllocationScope();
+    ~AllocationScope();
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+};
+
+#endif // ALLOCATIONAUDIT_H
@@ -0,0 +1,60 @@
+#ifndef BLOCKSCHEDULER_H
+#define BLOCKSCHEDULER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Work-stealing scheduler that hands out a range of items in fixed-size blocks. Every thread starts
+ * with a contiguous run of blocks and takes them front to back; once its own run is empty it steals
+ * from the back of the other threads' runs, so uneven blocks no longer leave threads waiting.
+ */
+class BlockScheduler {
+public:
+    BlockScheduler() = default;
+
+    BlockScheduler(const BlockScheduler&) = delete;
+    BlockScheduler& operator=(const BlockScheduler&) = delete;
+
+    /**
+     * Set the number of threads that take blocks from the scheduler.
+     * @param threadCount The number of participating threads.
+     */
+    void init(size_t threadCount);
+
+    /**
+     * Split a range of items into blocks and deal them out to the threads. Must not run while any
+     * thread is taking blocks.
+     * @param itemCount The number of items to schedule.
+     * @param blockSize The number of items per block.
+     */
+    void reset(size_t itemCount, size_t blockSize);
+
+    /**
+     * Take the next block for a thread, stealing from other threads when its own run is empty.
+     * @param thread The index of the calling thread.
+     * @param start Set to the index of the first item in the block.
+     * @param end Set to one past the index of the last item in the block.
+     * @return False once every block has been taken.
+     */
+    bool next(size_t thread, size_t& start, size_t& end);
+
+private:
+    // A thread's remaining blocks [front, back), packed into one word so the owner taking from
+    // the front and thieves taking from the back can both use a single compare-and-swap.
+    struct alignas(64) Run {
+        std::atomic<uint64_t> _range { 0 };
+    };
+
+    static bool takeFront(Run& run, uint32_t& block);
+    static bool takeBack(Run& run, uint32_t& block);
+
+    std::unique_ptr<Run[]> _runs;
+    size_t _threadCount = 0;
+    size_t _itemCount = 0;
+    size_t _blockSize = 1;
+};
+
+#endif // BLOCKSCHEDULER_H
@@ -0,0 +1,90 @@
+#ifndef NEIGHBORKERNELS_H
+#define NEIGHBORKERNELS_H
+
+#include <cstdint>
+
+/*
+ * Instruction sets the vectorized neighbor kernels are built for, narrowest first. Scalar uses the
+ * solver's own per-pair loops. Only x86-64 builds have the vector kernels.
+ */
+enum class SimdLevel { Scalar, SSE4, AVX2, AVX512 };
+
+/*
+ * Smoothing kernel and pressure constants of the current step, in the form the vector kernels
+ * take them.
+ */
+struct KernelConstants {
+    float _radius = 0.0f;
+    float _squareRadius = 0.0f;
+    float _spikyPow2 = 0.0f;
+    float _spikyPow3 = 0.0f;
+    float _spikyPow2Grad = 0.0f;
+    float _spikyPow3Grad = 0.0f;
+    float _targetDensity = 0.0f;
+    float _pressureMultiplier = 0.0f;
+    float _nearPressureMultiplier = 0.0f;
+};
+
+/*
+ * Particle arrays the kernels read neighbors from, indexed by particle.
+ */
+struct NeighborArrays {
+    const float* _x = nullptr;
+    const float* _y = nullptr;
+    const float* _z = nullptr;
+    const float* _density = nullptr;
+    const float* _nearDensity = nullptr;
+};
+
+/*
+ * The particle whose neighbors are visited, and what the kernels add up for it.
+ */
+struct NeighborQuery {
+    float _position[3] {};
+    float _pressure = 0.0f;
+    float _nearPressure = 0.0f;
+
+    float _density = 0.0f;
+    float _nearDensity = 0.0f;
+    float _force[3] {};
+    uint32_t _neighborCount = 0;
+};
+
+/*
+ * Vector kernels of one instruction set. Each walks a contiguous range of candidate neighbors
+ * several at a time, masks out those beyond the smoothing radius, and adds their contributions to
+ * the query one neighbor at a time, in range order, so the results match the scalar loops bit for
+ * bit.
+ */
+struct NeighborKernels {
+    // Add density and near density of the particles in [first, last).
+    void (*_densities)(const KernelConstants& constants, const NeighborArrays& arrays,
+        uint32_t first, uint32_t last, NeighborQuery& query);
+
+    // Add the pressure and near pressure force of the particles in [first, last), and count those
+    // within the radius. The range must not contain the query particle itself.
+    void (*_pressureForce)(const KernelConstants& constants, const NeighborArrays& arrays,
+        uint32_t first, uint32_t last, NeighborQuery& query);
+};
+
+/**
+ * Get the widest instruction set both this build and the CPU it runs on support. Detected once.
+ * @return The widest supported level, Scalar when no vector kernels are available.
+ */
+SimdLevel detectSimdLevel();
+
+/**
+ * Get the vector kernels of an instruction set.
+ * @param level The instruction set, which must not be wider than detectSimdLevel.
+ * @return The kernels, or nullptr for Scalar.
+ */
+const NeighborKernels* neighborKernels(SimdLevel level);
+
+/**
+ * Get the display name of an instruction set.
+ * @param level The instruction set.
+ * @return A static string such as "AVX2".
+ */
+const char* simdLevelName(SimdLevel level);
+
+#endif // NEIGHBORKERNELS_H
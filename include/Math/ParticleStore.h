@@ -0,0 +1,158 @@
+#ifndef PARTICLESTORE_H
+#define PARTICLESTORE_H
+
+#include "Math/Vec.h"
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Allocator that aligns every allocation to a cache line, so each particle field starts on its own
+ * line and can be streamed with aligned vector loads.
+ */
+template <typename T, std::size_t Alignment = 64> struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U> struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U> explicit AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+    {
+    }
+
+    T* allocate(const std::size_t count)
+    {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t { Alignment }));
+    }
+
+    void deallocate(T* pointer, std::size_t) noexcept
+    {
+        ::operator delete(pointer, std::align_val_t { Alignment });
+    }
+
+    bool operator==(const AlignedAllocator&) const = default;
+};
+
+template <typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+/*
+ * A vector quantity stored as one aligned array per component (x, y, z), so neighbor loops that
+ * only need one field read nothing else.
+ */
+struct Vec3Field {
+    AlignedVector<float> _x;
+    AlignedVector<float> _y;
+    AlignedVector<float> _z;
+
+    void resize(const std::size_t count)
+    {
+        _x.resize(count);
+        _y.resize(count);
+        _z.resize(count);
+    }
+
+    [[nodiscard]] Vec3<float> get(const std::size_t index) const
+    {
+        return { _x[index], _y[index], _z[index] };
+    }
+
+    void set(const std::size_t index, const Vec3<float>& value)
+    {
+        _x[index] = value[0];
+        _y[index] = value[1];
+        _z[index] = value[2];
+    }
+
+    void swap(Vec3Field& other) noexcept
+    {
+        _x.swap(other._x);
+        _y.swap(other._y);
+        _z.swap(other._z);
+    }
+};
+
+/*
+ * Structure-of-arrays particle storage used by the SPH solver. Every field lives in its own aligned
+ * array indexed by particle id.
+ */
+struct ParticleStore {
+    Vec3Field _position;
+    Vec3Field _predicted; // Predicted position for the current time step
+    Vec3Field _velocity;
+    AlignedVector<float> _density; // Density based on the smoothing kernel
+    AlignedVector<float> _nearDensity; // Near density for pressure calculations
+    AlignedVector<float> _pressure; // Implicit solver pressure, the next step's initial guess
+
+    [[nodiscard]] std::size_t size() const
+    {
+        return _density.size();
+    }
+
+    void resize(const std::size_t count)
+    {
+        _position.resize(count);
+        _predicted.resize(count);
+        _velocity.resize(count);
+        _density.resize(count);
+        _nearDensity.resize(count);
+        _pressure.resize(count);
+    }
+
+    /** Swap storage with another store. Only the array pointers are exchanged, nothing is copied.
+     */
+    void swap(ParticleStore& other) noexcept
+    {
+        _position.swap(other._position);
+        _predicted.swap(other._predicted);
+        _velocity.swap(other._velocity);
+        _density.swap(other._density);
+        _nearDensity.swap(other._nearDensity);
+        _pressure.swap(other._pressure);
+    }
+};
+
+/*
+ * Read-only view over a ParticleStore for consumers outside the solver (rendering, UI). It hides
+ * the storage layout behind per-particle accessors.
+ */
+class ParticleView {
+public:
+    explicit ParticleView(const ParticleStore& store)
+        : _store(&store)
+    {
+    }
+
+    [[nodiscard]] std::size_t size() const
+    {
+        return _store->size();
+    }
+
+    [[nodiscard]] Vec3<float> position(const std::size_t index) const
+    {
+        return _store->_position.get(index);
+    }
+
+    [[nodiscard]] Vec3<float> velocity(const std::size_t index) const
+    {
+        return _store->_velocity.get(index);
+    }
+
+    [[nodiscard]] float density(const std::size_t index) const
+    {
+        return _store->_density[index];
+    }
+
+    [[nodiscard]] float nearDensity(const std::size_t index) const
+    {
+        return _store->_nearDensity[index];
+    }
+
+private:
+    const ParticleStore* _store;
+};
+
+#endif // PARTICLESTORE_H
@@ -1,12 +1,83 @@
 #ifndef SPH_H
 #define SPH_H
 
+#include "Math/BlockScheduler.h"
+#include "Math/NeighborKernels.h"
+#include "Math/ParticleStore.h"
+#include "Math/SmoothingKernels.h"
 #include "Particle.h"
+#include "PerfCounters.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <barrier>
+#include <chrono>
+#include <memory>
 #include <thread>
 #include <vector>
 
+/*
+ * Neighbor search structure. Hashed maps cells to keys with a spatial hash and works for any
+ * domain; Dense indexes cells of the bounding box directly, so lookups have no collisions and
+ * neighboring cells along x are contiguous in memory.
+ */
+enum class NeighborGrid { Hashed, Dense };
+
+/*
+ * Order in which particles are stored after each step's sort. CellKey follows the grid's own keys
+ * (row-major cells or hash values); Morton and Hilbert follow a space-filling curve over the cell
+ * coordinates, so particles in adjacent cells also end up close in memory.
+ */
+enum class ParticleOrder { CellKey, Morton, Hilbert };
+
+/*
+ * How pressure is computed. StateEquation derives it directly from each particle's density through
+ * stiff multipliers; Implicit (IISPH) iterates pressures until the predicted compression is within
+ * SPHConfig::densityTolerance, which stays stable at much longer time steps. PositionBased (PBF)
+ * skips pressure altogether and moves the predicted positions a fixed number of times to undo the
+ * compression, then derives the velocities from how far the particles moved.
+ */
+enum class PressureSolver { StateEquation, Implicit, PositionBased };
+
+/*
+ * Phases of a simulation step, in the order threadStep runs them. Used to time a single phase in
+ * isolation; Step is the whole step.
+ */
+enum class SPHPhase {
+    Step,
+    ExternalForces,
+    SpatialHash,
+    Offsets,
+    Reorder,
+    NeighborLists,
+    Densities,
+    PressureSolve,
+    PressureForce,
+    Viscosity,
+    UpdatePositions,
+};
+
+inline constexpr size_t PHASE_COUNT = static_cast<size_t>(SPHPhase::UpdatePositions) + 1;
+
+/** Get the name of a phase, which is the name of the function that runs it.
+ * @param phase The phase.
+ * @return The name, or "step" for the whole step.
+ */
+const char* phaseName(SPHPhase phase);
+
+/*
+ * Time one worker spent in each phase of the last step in milliseconds, split into work and
+ * waiting at barriers for the other workers. With SPHConfig::hardwareCounters, also the hardware
+ * counts of the work, leaving out the waits. Indexed by SPHPhase; the Step entries stay zero.
+ */
+struct PhaseTimes {
+    std::array<float, PHASE_COUNT> _work {};
+    std::array<float, PHASE_COUNT> _wait {};
+    std::array<CounterValues, PHASE_COUNT> _counters {};
+    bool _counted = false; // Whether _counters were sampled, false when counters are unavailable
+};
+
 struct SPHConfig {
     float gravity = -9.81f;
     float smoothingRadius = 0.2f;
@@ -16,6 +87,40 @@ struct SPHConfig {
     float viscosityStrength = 0.035f;
     float collisionDamping = 0.85f;
     Vec3<float> bounds { 1.0f, 1.0f, 1.0f };
+    NeighborGrid neighborGrid = NeighborGrid::Dense;
+    ParticleOrder particleOrder = ParticleOrder::CellKey;
+    bool neighborLists = false; // Reuse per-particle neighbor lists across steps
+    float neighborSkin = 0.02f; // Extra search distance that lets neighbor lists be reused
+    // Evaluate pressure and viscosity once per pair. Each thread keeps force sums for every
+    // particle, 16 bytes each, so memory grows as threads x particles, and gathering the sums reads
+    // up to one entry per thread for each particle.
+    bool symmetricPairs = false;
+    bool fusedForces = false; // Pressure and viscosity in one neighbor pass (state equation only)
+    SimdLevel simdLevel = SimdLevel::AVX512; // Widest neighbor kernels, capped by the CPU
+    SmoothingKernel smoothingKernel = SmoothingKernel::Spiky; // Density and pressure kernel shape
+    int dimensions = 3; // 2 flattens the particles onto the z = 0 plane; only read by init
+    bool hardwareCounters = false; // Sample perf counters around every phase (Linux only)
+    float frameTime = 1 / 60.0f; // Simulated time one step() call advances
+    bool adaptiveTimestep = false; // Split each frame into substeps short enough to stay stable
+    float courantNumber = 0.4f; // Fraction of the smoothing radius a particle may cross per substep
+    float forceNumber = 0.25f; // Acceleration limit, dt <= forceNumber * sqrt(h / acceleration)
+    int maxSubsteps = 16; // Upper bound on substeps per frame
+    PressureSolver pressureSolver = PressureSolver::StateEquation;
+    float densityTolerance = 0.01f; // Implicit solver: mean compression left, over targetDensity
+    int maxPressureIterations = 50; // Implicit solver: iteration limit per substep
+    float pressureRelaxation = 0.5f; // Implicit solver: relaxed Jacobi weight
+    int constraintIterations = 4; // Position based solver: projections per substep
+    float constraintSoftness = 0.01f; // Position based solver: epsilon added to each denominator
+    float tensileCorrection = 0.01f; // Position based solver: artificial pressure against clumping
+};
+
+/*
+ * Destination for per-particle render data, written by the integration pass of every step so no
+ * separate copy pass is needed. Positions and colors are packed three floats per particle.
+ */
+struct InstanceSink {
+    float* _positions = nullptr;
+    float* _colors = nullptr;
 };
 
 /*
@@ -30,22 +135,34 @@ public:
      */
     static SPH& getInstance();
 
-    /** Initialize the SPH simulation with the given configuration and initial particles.
+    /** Initialize the SPH simulation with the given configuration and initial particles. Workers
+     * from an earlier init are stopped first, so the solver can be re-initialized.
      * @param config The simulation parameters (gravity, smoothing radius, etc.).
      * @param particles The initial set of particles to simulate.
+     * @param threads The number of threads to step with, 0 to use every hardware thread.
      */
-    void init(SPHConfig config = {}, const std::vector<Particle>& particles = {});
+    void init(
+        SPHConfig config = {}, const std::vector<Particle>& particles = {}, size_t threads = 0);
 
     /** Destructor for the SPH simulation, responsible for cleaning up resources and stopping worker
      * threads.
      */
     ~SPH();
 
-    /** Step the simulation forward by a given time delta.
-     * @param dt The time step to advance the simulation.
+    /** Advance the simulation by SPHConfig::frameTime. With adaptiveTimestep, the frame is split
+     * into as many equal substeps as the fastest particle and the largest acceleration of the
+     * previous substep call for; otherwise it is a single substep.
      */
     void step();
 
+    /** Run one phase of the step on all workers, for benchmarking. The phase works on the current
+     * state, so at least one full step must have run to build the neighbor search structures.
+     * Reorder fills the reorder buffer without swapping it in, and with a single thread the
+     * counting sort in SpatialHash also builds the offsets, leaving Offsets with nothing to do.
+     * @param phase The phase to run.
+     */
+    void runPhase(SPHPhase phase);
+
     /** Update the simulation configuration parameters.
      * @param config The new configuration to apply to the simulation.
      */
@@ -56,38 +173,110 @@ public:
      */
     [[nodiscard]] const SPHConfig& config() const;
 
-    /** Get the current list of particles in the simulation.
-     * @return A const reference to the vector of particles.
+    /** Get the time each thread spent waiting for the others at barriers during the last step.
+     * @return Milliseconds per thread, the stepping thread first.
      */
-    [[nodiscard]] const std::vector<Particle>& particles() const
-    {
-        return _particles;
-    }
+    [[nodiscard]] const std::vector<float>& idleTimes() const;
+
+    /** Get the time every thread spent in each phase of the last step or runPhase call.
+     * @return Phase times per thread, the stepping thread first.
+     */
+    [[nodiscard]] const std::vector<PhaseTimes>& phaseTimes() const;
+
+    /** Get the wall time of the last step.
+     * @return The step time in milliseconds.
+     */
+    [[nodiscard]] float stepTime() const;
 
-    /** Get a non-const reference to the current list of particles (for modification).
-     * @return A reference to the vector of particles.
+    /** Get the number of substeps the last step was split into.
+     * @return The substep count, 1 without adaptive time stepping.
      */
-    [[nodiscard]] std::vector<Particle>& particles()
+    [[nodiscard]] int substepCount() const;
+
+    /** Get the instruction set the density and pressure passes ran with in the last step.
+     * @return The level, Scalar when no vector kernels were used.
+     */
+    [[nodiscard]] SimdLevel simdLevel() const;
+
+    /** Get the time step of the last substep.
+     * @return The substep length in seconds of simulated time.
+     */
+    [[nodiscard]] float timestep() const;
+
+    /** Get the number of iterations the implicit or position based solver took in the last
+     * substep.
+     * @return The iteration count, 0 with the state equation.
+     */
+    [[nodiscard]] int pressureIterations() const;
+
+    /** Get the mean compression the implicit or position based solver ended the last substep
+     * with. For the position based solver this is measured before the last projection.
+     * @return The density error as a fraction of the target density.
+     */
+    [[nodiscard]] float densityError() const;
+
+    /** Get the number of threads the solver steps with, including the calling thread.
+     * @return The thread count chosen by init.
+     */
+    [[nodiscard]] size_t threadCount() const;
+
+    /** Get a read-only view of the particles in the simulation.
+     * @return A view over the solver's structure-of-arrays particle storage.
+     */
+    [[nodiscard]] ParticleView particles() const
     {
-        return _particles;
+        return ParticleView(_particles);
     }
 
+    /** Set where the next steps write particle positions and colors. The buffers must hold every
+     * particle; pass an empty sink to stop writing.
+     * @param sink The destination buffers.
+     */
+    void setInstanceSink(const InstanceSink& sink);
+
 private:
     SPHConfig _config;
-    float _dt = 1 / 60.0f;
-    std::vector<Particle> _particles;
+    float _dt = 1 / 60.0f; // Length of the current substep
+    int _substepCount = 0;
+    bool _finalSubstep = true; // Whether the current substep ends the frame
+    std::vector<float> _maxSpeed; // Per-thread squared speed after the last substep
+    std::vector<float> _maxAcceleration; // Per-thread squared pressure acceleration, same substep
+    ParticleStore _particles;
+    InstanceSink _instanceSink;
 
     // Multithreading members.
     std::vector<std::thread> _threads;
     std::unique_ptr<std::barrier<>> _barrier;
     std::atomic<bool> _running { true };
+    size_t _threadCount = 1;
     size_t _chunk;
+    BlockScheduler _densityBlocks;
+    BlockScheduler _pressureBlocks;
+    BlockScheduler _viscosityBlocks;
+    std::vector<float> _idleTime; // Barrier wait per thread in the last step, in milliseconds
+    std::vector<PhaseTimes> _phaseTimes; // Per thread, copied from _profiles after each step
 
-    // Precomputed kernel constants (depend on smoothingRadius).
-    float K_SpikyPow2 = 0.0f;
-    float K_SpikyPow3 = 0.0f;
-    float K_SpikyPow2Grad = 0.0f;
-    float K_SpikyPow3Grad = 0.0f;
+    // Phase timer state of one worker, padded to a cache line so workers never share one.
+    struct alignas(64) ThreadProfile {
+        PhaseTimes _times;
+        SPHPhase _phase = SPHPhase::Step;
+        std::chrono::steady_clock::time_point _mark;
+        PerfCounters _counters;
+        CounterValues _counterMark; // Counts at _mark
+        bool _counting = false;
+        bool _countersFailed = false; // Opening the counters failed, so it is not retried
+    };
+    std::vector<ThreadProfile> _profiles;
+    float _stepTime = 0.0f;
+    SPHPhase _phase = SPHPhase::Step; // What the workers run after the start barrier
+
+    // Kernel coefficients for the current smoothingRadius, refreshed by every step.
+    int _dimensions = 3; // Fixed by init, since 2D particles are flattened there
+    SmoothingKernel _smoothingKernel = SmoothingKernel::Spiky;
+    KernelCoefficients _densityKernel; // Of _smoothingKernel's shape
+    KernelCoefficients _nearKernel; // SpikyPow3Kernel
+    KernelCoefficients _viscosityKernel; // Poly6Kernel
+    float _densitySlope = 0.0f; // Largest |dW/dr| of the density kernel, bounds implicit pressures
 
     explicit SPH() = default;
 
@@ -97,8 +286,18 @@ private:
      * the simulation before proceeding to the next step.
      * @param thread The index of the thread to determine which portion of the particle list to
      * process.
+     * @return False if the simulation was stopped instead of stepped.
+     */
+    bool threadStep(size_t thread);
+
+    /** Run every phase of a substep on a worker thread, called by threadStep once the workers
+     * are released. The neighbor passes below take the density kernel policy (SpikyKernel,
+     * Poly6Kernel, CubicSplineKernel or WendlandC2Kernel of 2 or 3 dimensions) as a template
+     * argument, so threadStep picks the instantiation for _smoothingKernel and _dimensions once,
+     * and the kernels and the neighbor stencil inline into their loops.
+     * @param thread The index of the calling worker thread.
      */
-    void threadStep(size_t thread);
+    template <typename Kernel> void threadSubstep(size_t thread);
 
     /**
      * Keeps the worker thread running in a loop, continuously performing simulation steps until the
@@ -108,77 +307,425 @@ private:
      */
     void threadLoop(size_t thread);
 
-    // Kernel functions used for density/pressure/viscosity.
-    [[nodiscard]] float densityKernel(float dst) const;
-    [[nodiscard]] float nearDensityKernel(float dst) const;
-    [[nodiscard]] float densityDerivative(float dst) const;
-    [[nodiscard]] float nearDensityDerivative(float dst) const;
-    [[nodiscard]] float poly6Kernel(float dst) const;
+    /** Stop the worker threads and wait for them to exit. Does nothing if none are running.
+     */
+    void stopWorkers();
+
+    /** Advance the simulation by _dt on all workers.
+     */
+    void substep();
+
+    /** Get the longest substep that keeps the fastest particle within the Courant limit and the
+     * largest acceleration within the force limit, using the maxima of the previous substep.
+     * @return The time step, between frameTime / maxSubsteps and frameTime.
+     */
+    [[nodiscard]] float stableTimestep() const;
+
+    /** Run the part of a single phase assigned to a worker thread.
+     * @param thread The index of the calling worker thread.
+     * @param phase The phase to run.
+     */
+    template <typename Kernel> void threadPhase(size_t thread, SPHPhase phase);
+
+    /** Wait at the barrier for the other workers. The time spent waiting is added to the calling
+     * thread's current phase as wait time, and the time since the last mark as work.
+     * @param thread The index of the calling worker thread.
+     */
+    void waitForWorkers(size_t thread);
+
+    /** Add the time since the last mark to the calling thread's current phase, then switch to a
+     * new phase.
+     * @param thread The index of the calling worker thread.
+     * @param phase The phase the thread starts.
+     */
+    void beginPhase(size_t thread, SPHPhase phase);
+
+    /** Start sampling hardware counters on the calling thread for this step, opening them on
+     * first use.
+     * @param profile The calling thread's profile.
+     * @return False if the counters are not available.
+     */
+    static bool startCounters(ThreadProfile& profile);
+
+    /** Read the calling thread's hardware counters and move the mark. Does nothing unless the
+     * thread is counting.
+     * @param profile The calling thread's profile.
+     * @param attribute Whether to add the counts since the last mark to the current phase.
+     */
+    static void sampleCounters(ThreadProfile& profile, bool attribute);
+
+    /** Clear every thread's phase times before a step. Only called by the stepping thread while
+     * the workers wait at the start barrier.
+     */
+    void resetProfiles();
+
+    /** Copy every thread's phase times to _phaseTimes and _idleTime after a step.
+     */
+    void publishProfiles();
+
+    // Equations of state used by the pressure passes.
     [[nodiscard]] float pressureFromDensity(float density) const;
     [[nodiscard]] float nearPressureFromDensity(float nearDensity) const;
 
     // Spatial hashing for neighbor lookup.
     static const Vec3<int> OFFSETS_3D[27];
-    [[nodiscard]] Vec3<int> getCell(const Particle& particle) const;
+    static const Vec3<int> OFFSETS_2D[9]; // The z = 0 layer of OFFSETS_3D
+    [[nodiscard]] Vec3<int> getCell(size_t index) const;
     static int hash(const Vec3<int>& cell);
     [[nodiscard]] uint32_t keyFromHash(uint32_t hash) const;
 
+    // Dense grid lookup inside the bounds.
+    [[nodiscard]] Vec3<int> getGridCell(size_t index) const;
+
+    // Cell keys for the current grid and particle order.
+    [[nodiscard]] uint32_t cellKey(size_t index) const;
+    [[nodiscard]] uint32_t keyFromCell(const Vec3<int>& cell) const;
+
+    /** Pick the neighbor grid and cell size for this step from the config and size the cell table
+     * to match. Called once per step before the workers are released.
+     */
+    void updateGridLayout();
+
+    /** Visit every range of particles that may hold neighbors of the given particle. The visitor
+     * is called with [first, last) index ranges into the sorted particle arrays: 27 cells, or 9
+     * rows of 3 cells on a dense grid in cell key order. In 2D only the particle's own layer of
+     * cells is walked, 9 cells or 3 rows.
+     * @param index The index of the particle whose neighborhood to visit.
+     * @param visit The callable invoked with each range.
+     */
+    template <int Dimensions, typename Visitor>
+    void forEachNeighborRange(size_t index, Visitor&& visit) const;
+
+    /** Visit every candidate neighbor of the given particle, the particle itself included. Reads
+     * the particle's neighbor list when lists are in use and walks the grid otherwise.
+     * @param index The index of the particle whose neighbors to visit.
+     * @param visit The callable invoked with each candidate's index.
+     */
+    template <int Dimensions, typename Visitor>
+    void forEachNeighbor(size_t index, Visitor&& visit) const;
+
+    /** Visit every candidate neighbor with a larger index than the given particle, so each pair
+     * is seen from one side only. On a dense grid in cell key order this walks the half stencil:
+     * the rest of the particle's own row and the rows after it.
+     * @param index The index of the particle whose neighbors to visit.
+     * @param visit The callable invoked with each candidate's index.
+     */
+    template <int Dimensions, typename Visitor>
+    void forEachNeighborPair(size_t index, Visitor&& visit) const;
+
     /** Resolve collisions with the simulation bounds and apply damping.
-     * @param particle The particle to check for collisions and resolve.
+     * @param index The index of the particle to check for collisions and resolve.
      */
-    void resolveCollisions(Particle& particle) const;
+    void resolveCollisions(size_t index);
 
     /** Apply gravity to the particles and predict their new positions.
-     * @param start An iterator pointing to the start of the particle range to process.
-     * @param end An iterator pointing to the end of the particle range to process.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
      */
-    void applyExternalForces(auto start, auto end);
+    void applyExternalForces(size_t start, size_t end);
 
-    /** Build the spatial hash for efficient neighbor searching. This involves:
+    /** Build the spatial hash for efficient neighbor searching. Each particle's cell key is
+     * computed and the particles are counting-sorted by key, producing _sortedIndices and the
+     * cell start table _offsets (cell k spans [_offsets[k], _offsets[k + 1])) in a single pass.
      */
     void buildSpatialHash();
 
+    /** Parallel version of buildSpatialHash that every worker joins. Particles are sorted by key
+     * with an LSD radix sort: per-thread digit histograms, a parallel prefix sum and a stable
+     * scatter per pass. The result is left in _sortedKeys and _sortedIndices.
+     * @param thread The index of the calling worker thread.
+     */
+    void sortSpatialHash(size_t thread);
+
+    /** Exclusive prefix sum over an array, split across all workers.
+     * @param thread The index of the calling worker thread.
+     * @param values The array to scan in place.
+     * @param size The number of elements in the array.
+     */
+    void exclusiveScan(size_t thread, uint32_t* values, size_t size);
+
+    /** Fill the cell start table _offsets from _sortedKeys for a range of sorted positions.
+     * @param start The index of the first sorted position to process.
+     * @param end One past the index of the last sorted position to process.
+     */
+    void buildOffsets(size_t start, size_t end);
+
+    /** Largest squared distance any particle in a range moved since the neighbor lists were built.
+     * @param start The index of the first particle to check.
+     * @param end One past the index of the last particle to check.
+     * @return The squared displacement, compared against half the skin.
+     */
+    [[nodiscard]] float maxListDisplacement(size_t start, size_t end) const;
+
+    /** Build the neighbor lists from the freshly sorted grid, with every worker joining. Each
+     * particle lists all particles within smoothingRadius + neighborSkin, so the lists stay valid
+     * until some particle has moved more than half the skin. Lists are stored back to back in
+     * _neighbors, particle i spanning [_neighborOffsets[i], _neighborOffsets[i + 1]). When they
+     * outgrow the capacity reserved by the first build for the cell size, _listsOverflowed is set
+     * instead and the neighbor passes search the grid.
+     * @param thread The index of the calling worker thread.
+     */
+    template <int Dimensions> void buildNeighborLists(size_t thread);
+
     /** Reorder the particles in memory based on the sorted keys to improve cache locality during
-     * neighbor searches. This should be called after building the spatial hash to ensure particles
-     * are stored in an order that reflects their spatial locality.
+     * neighbor searches. This gathers a range of the sorted order into _reorderBuffer, which is
+     * swapped with _particles once every range is done.
+     * @param start The index of the first sorted position to gather.
+     * @param end One past the index of the last sorted position to gather.
      */
-    void reorderParticles();
+    void reorderParticles(size_t start, size_t end);
 
     /** Calculate the density and near-density for each particle based on its neighbors.
-     * @param start An iterator pointing to the start of the particle range to process.
-     * @param end An iterator pointing to the end of the particle range to process.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     */
+    template <typename Kernel> void calculateDensities(size_t start, size_t end);
+
+    /** Density pass of the implicit solver. In the same neighbor loop, also computes each
+     * particle's diagonal terms, its density after advection by the current velocities, and the
+     * initial pressure guess from the last substep.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     */
+    template <typename Kernel> void calculateImplicitDensities(size_t start, size_t end);
+
+    /** Iterate the implicit pressures on all workers until the mean compression is within
+     * tolerance. Each iteration takes two passes over the neighbors, separated by barriers.
+     * @param thread The index of the calling worker thread.
+     * @return The index of the _solverPressure buffer holding the final pressures.
+     */
+    template <typename Kernel> size_t solvePressure(size_t thread);
+
+    /** First pass of a pressure iteration: sum every particle's displacement from its neighbors'
+     * pressures.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @param source The _solverPressure buffer holding the current pressures.
      */
-    void calculateDensities(auto start, auto end);
+    template <typename Kernel>
+    void sumPressureDisplacements(size_t start, size_t end, size_t source);
+
+    /** Second pass of a pressure iteration: relax every particle's pressure toward the value that
+     * removes its compression, writing it into the other _solverPressure buffer. Pressures are
+     * bounded by the acceleration limit SPHConfig::forceNumber puts on a frame.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @param source The _solverPressure buffer holding the current pressures.
+     * @return The summed compression of the range before the update.
+     */
+    template <typename Kernel> float relaxPressures(size_t start, size_t end, size_t source);
+
+    /** Density pass of the position based solver: compute each particle's density at the given
+     * positions and the scaling factor (lambda) that corrects its compression.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @param positions The positions to evaluate the constraints at.
+     * @return The summed compression of the range, above the target density.
+     */
+    template <typename Kernel>
+    float calculateConstraints(size_t start, size_t end, const Vec3Field& positions);
+
+    /** Project the density constraints on all workers for the configured number of iterations.
+     * The first scaling factors come from the density pass; every further iteration recomputes
+     * them at the corrected positions, with barriers between the passes.
+     * @param thread The index of the calling worker thread.
+     * @return The index of the _projected buffer holding the final positions.
+     */
+    template <typename Kernel> size_t projectConstraints(size_t thread);
+
+    /** Move every particle by its position correction and keep it inside the bounds.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @param from The positions the scaling factors were computed at.
+     * @param to Receives the corrected positions.
+     */
+    template <typename Kernel>
+    void projectPositions(size_t start, size_t end, const Vec3Field& from, Vec3Field& to);
+
+    /** Set the velocities of the position based solver from the distance each particle moved over
+     * the substep. Also writes _velocitySnapshot for the viscosity pass.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @param projected The final corrected positions.
+     * @return The largest squared change in velocity per second in the range.
+     */
+    float updateProjectedVelocities(size_t start, size_t end, const Vec3Field& projected);
+
+    /** Apply the solved pressures as forces, together with the near pressure that keeps particles
+     * from clumping, and keep the pressures as the next substep's initial guess.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @param source The _solverPressure buffer holding the final pressures.
+     * @return The largest squared pressure acceleration in the range.
+     */
+    template <typename Kernel>
+    float calculateImplicitPressureForce(size_t start, size_t end, size_t source);
 
     /** Calculate the pressure force for each particle based on its density and the densities of its
-     * neighbors.
-     * @param start An iterator pointing to the start of the particle range to process.
-     * @param end An iterator pointing to the end of the particle range to process.
+     * neighbors. The updated velocities are also written to _velocitySnapshot for the viscosity
+     * pass.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @return The largest squared pressure acceleration in the range.
+     */
+    template <typename Kernel> float calculatePressureForce(size_t start, size_t end);
+
+    /** Calculate the pressure and viscosity forces together in a single neighbor pass. Viscosity
+     * compares the velocities from before the pass instead of after the pressure update, so the
+     * new velocities go to _velocitySnapshot and updatePositions moves them into place.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @return The largest squared pressure acceleration in the range.
+     */
+    template <typename Kernel> float calculateForces(size_t start, size_t end);
+
+    /** Pair-wise version of calculatePressureForce that every worker joins. Each pair is
+     * evaluated once and applied to both particles through per-thread accumulators, which are
+     * summed per particle over the static chunks after a barrier. The accumulators span every
+     * particle, so they take O(threads x particles) memory and the sums O(threads) reads per
+     * particle, less where a thread's touched range leaves the particle out.
+     * @param thread The index of the calling worker thread.
+     * @return The largest squared pressure acceleration in the thread's chunk.
      */
-    void calculatePressureForce(auto start, auto end);
+    template <typename Kernel> float calculatePressureForcePairs(size_t thread);
 
-    /** Calculate the viscosity force for each particle based on the velocities of its neighbors.
-     * @param velocitySnapshot A snapshot of the particle velocities to use for calculating
-     * viscosity forces.
-     * @param start An iterator pointing to the start of the particle range to process.
-     * @param end An iterator pointing to the end of the particle range to process.
+    /** Calculate the viscosity force for each particle based on the velocities of its neighbors
+     * (read from _velocitySnapshot).
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
      */
-    void calculateViscosity(auto start, auto end);
+    template <typename Kernel> void calculateViscosity(size_t start, size_t end);
+
+    /** Pair-wise version of calculateViscosity that every worker joins, see
+     * calculatePressureForcePairs.
+     * @param thread The index of the calling worker thread.
+     */
+    template <typename Kernel> void calculateViscosityPairs(size_t thread);
+
+    /** Sum and clear the pair contributions every thread accumulated for a particle.
+     * @param index The index of the particle.
+     * @param neighborCount Incremented by the number of pairs the particle took part in.
+     * @return The summed force.
+     */
+    Vec3<float> takePairForce(size_t index, uint32_t& neighborCount);
 
     /** Update the positions of the particles based on their velocities and resolve any collisions
-     * with the bounds.
-     * @param start An iterator pointing to the start of the particle range to process.
-     * @param end An iterator pointing to the end of the particle range to process.
+     * with the bounds. Also writes the particles to the instance sink, if one is set.
+     * @param start The index of the first particle to process.
+     * @param end One past the index of the last particle to process.
+     * @return The largest squared speed in the range.
      */
-    void updatePositions(auto start, auto end);
+    float updatePositions(size_t start, size_t end);
 
     // Working buffers to avoid reallocating every step.
     std::vector<uint32_t> _keys;
+    std::vector<uint32_t> _sortedKeys;
     std::vector<uint32_t> _sortedIndices;
-    std::vector<uint32_t> _offsets;
-    std::vector<Particle> _reorderBuffer;
-    std::vector<Vec3<float>> _velocitySnapshot;
+    std::vector<uint32_t> _indexScratch;
+    std::vector<uint32_t> _offsets; // Cell start table, _keyCount + 1 entries
+    std::vector<uint32_t> _histograms; // Radix digit counts, digit-major then thread
+    std::vector<uint32_t> _blockSums;
+    ParticleStore _reorderBuffer;
+    Vec3Field _velocitySnapshot;
     bool _useViscosity = true;
+    bool _fusedForces = false; // Velocities of this step are in _velocitySnapshot until integrated
+
+    // Vector kernels for the density and pressure passes, nullptr for the scalar loops.
+    SimdLevel _simdLevel = SimdLevel::Scalar;
+    const NeighborKernels* _kernels = nullptr;
+    KernelConstants _kernelConstants;
+
+    // Per-thread force sums for the pair-wise passes, indexed by particle and sized by step before
+    // the passes run, so they never grow mid-step. Threads take blocks anywhere in the array, so
+    // each one tracks the index range it touched. Entries are zeroed when they are summed, so they
+    // are clean for the next pass.
+    struct PairAccumulator {
+        size_t _first = 0; // Touched entries in the current pass are [_first, _last)
+        size_t _last = 0;
+        Vec3Field _force;
+        std::vector<uint32_t> _count;
+
+        void resize(const size_t count)
+        {
+            _force.resize(count);
+            _count.resize(count);
+        }
+
+        void add(const size_t index, const Vec3<float>& force, const uint32_t count)
+        {
+            _first = std::min(_first, index);
+            _last = std::max(_last, index + 1);
+            _force._x[index] += force[0];
+            _force._y[index] += force[1];
+            _force._z[index] += force[2];
+            _count[index] += count;
+        }
+    };
+    std::vector<PairAccumulator> _pairAccumulators;
+    bool _symmetricPairs = false;
+
+    // Implicit pressure solver state, per particle in the current order.
+    bool _implicitPressure = false;
+    Vec3Field _selfDisplacement; // Displacement per unit of the particle's own pressure (d_ii)
+    Vec3Field _neighborDisplacement; // Displacement caused by the neighbors' pressures
+    AlignedVector<float> _pressureDiagonal; // Compression per unit of own pressure (a_ii)
+    AlignedVector<float> _advectedDensity; // Density after moving with the current velocities
+    std::array<AlignedVector<float>, 2> _solverPressure; // Jacobi iterates, read one, write other
+    std::vector<float> _densityErrors; // Per-thread summed compression of the last iteration
+    BlockScheduler _displacementBlocks;
+    BlockScheduler _relaxBlocks;
+    size_t _finalPressure = 0; // _solverPressure buffer with the last solution
+    int _pressureIterations = 0;
+    float _densityError = 0.0f;
+
+    // Position based solver state. The constraints are projected between two buffers so that
+    // _predicted, which the neighbor search looks cells up from, stays as it was hashed.
+    bool _positionBased = false;
+    std::array<Vec3Field, 2> _projected;
+    AlignedVector<float> _lambda; // Scaling factor of each particle's density constraint
+    size_t _finalProjection = 0; // _projected buffer with the last positions
+
+    // Verlet neighbor lists, reused until a particle moves more than half the skin.
+    bool _useNeighborLists = false;
+    bool _forceListRebuild = true;
+    float _listCellSize = 0.0f; // Cell size the current lists were built with, 0 if none
+    std::vector<uint32_t> _neighbors;
+    float _neighborsCellSize = 0.0f; // Cell size _neighbors' capacity was reserved for
+    bool _listsOverflowed = false; // The last build did not fit _neighbors, so the grid is searched
+    std::vector<uint32_t> _neighborOffsets; // List start table, one entry per particle plus one
+    std::vector<float> _maxDisplacement; // Per-thread squared displacement since the last build
+    Vec3Field _listPositions; // Predicted positions when the lists were built
+
+    // Neighbor grid layout for the current step.
+    bool _denseGrid = false;
+    float _cellSize = 0.2f; // Smoothing radius, widened by the skin when lists are in use
+    size_t _keyCount = 0;
+    Vec3<int> _gridDims { 1, 1, 1 };
+    ParticleOrder _particleOrder = ParticleOrder::CellKey;
+    uint32_t _curveBits = 1;
+    std::vector<uint32_t> _curveKeys; // Curve key of each dense cell, in row-major order
+    Vec3<int> _curveKeysDims { 0, 0, 0 }; // Grid _curveKeys was built for
+    ParticleOrder _curveKeysOrder = ParticleOrder::CellKey;
 };
 
+/** Measure the density a scene rests at, for use as SPHConfig::targetDensity: the median particle
+ * density after one state equation step from the given particles. A target far below it can ask
+ * the fluid to spread into more volume than the bounds hold, which the implicit solver cannot
+ * converge to. This re-initializes the SPH singleton.
+ * @param config The simulation parameters; the pressure solver and time stepping are ignored.
+ * @param particles The initial particles of the scene.
+ * @return The median density, or config.targetDensity when there are no particles.
+ */
+float restDensity(SPHConfig config, const std::vector<Particle>& particles);
+
+/** Turn a 3D config into the 2D one whose particles have as many neighbors, for a scene whose
+ * particles are flattened onto the z = 0 plane from a box of the given depth. Flattening packs
+ * them that much closer, so the smoothing radius shrinks to keep the neighbor count, and the
+ * skin and forces shrink with it as sph_bench scales them with the particle count.
+ * @param config The 3D simulation parameters.
+ * @param depth The extent along z the particles were spread over before flattening.
+ * @return The config with dimensions set to 2 and its lengths and forces scaled.
+ */
+SPHConfig planarConfig(SPHConfig config, float depth);
+
 #endif // SPH_H
@@ -0,0 +1,265 @@
+#ifndef SMOOTHINGKERNELS_H
+#define SMOOTHINGKERNELS_H
+
+#include "Rules.h"
+#include <utility>
+
+/*
+ * Shape of the kernel that weighs neighbors in the density and pressure passes. Spiky is the sharp
+ * (h - r)^2 kernel the default multipliers were tuned for; Poly6 is smoother but its gradient
+ * vanishes at the center; CubicSpline and WendlandC2 are bell shapes whose gradients stay finite,
+ * Wendland being the least prone to particles pairing up. Each integrates to one over its support,
+ * so densities stay on the same scale whichever is picked.
+ */
+enum class SmoothingKernel { Spiky, Poly6, CubicSpline, WendlandC2 };
+
+/*
+ * Coefficients of a kernel for one smoothing radius h. Kernels are functions of the distance r
+ * with support [0, h]; _value scales the kernel and _gradient its derivative along r. Both depend
+ * on the number of dimensions the kernel is normalized over.
+ */
+struct KernelCoefficients {
+    float _radius = 0.0f;
+    float _inverseRadius = 0.0f;
+    float _value = 0.0f;
+    float _gradient = 0.0f;
+};
+
+/*
+ * Kernel policies, templated on the number of dimensions (2 or 3), which the solver's neighbor
+ * passes read back as DIMENSIONS. Each provides a constexpr coefficients(h), evaluated once per
+ * radius and normalized for its dimensions, and value and derivative at a distance, written so
+ * that code templated on the policy inlines them into the neighbor loops. Both are zero outside
+ * the support, and the same in 2D and 3D.
+ */
+namespace smoothing_kernels {
+// Integer power in double, matching the precision the coefficients were first computed with.
+constexpr double power(const double base, const int exponent)
+{
+    double result = 1.0;
+    for (int i = 0; i < exponent; ++i)
+        result *= base;
+    return result;
+}
+} // namespace smoothing_kernels
+
+// 15 / (2 pi h^5) (h - r)^2, or 6 / (pi h^4) (h - r)^2 in 2D.
+template <int Dimensions> struct SpikyKernel {
+    static constexpr int DIMENSIONS = Dimensions;
+
+    static constexpr KernelCoefficients coefficients(const float radius)
+    {
+        using smoothing_kernels::power;
+        if constexpr (Dimensions == 2) {
+            return { radius, 1.0f / radius, static_cast<float>(6.0f / (PI * power(radius, 4))),
+                static_cast<float>(12.0f / (PI * power(radius, 4))) };
+        }
+        return { radius, 1.0f / radius, static_cast<float>(15.0f / (2.0f * PI * power(radius, 5))),
+            static_cast<float>(15.0f / (PI * power(radius, 5))) };
+    }
+
+    static constexpr float value(const KernelCoefficients& kernel, const float distance)
+    {
+        if (distance < kernel._radius) {
+            const float v = kernel._radius - distance;
+            return v * v * kernel._value;
+        }
+        return 0.0f;
+    }
+
+    static constexpr float derivative(const KernelCoefficients& kernel, const float distance)
+    {
+        if (distance <= kernel._radius) {
+            const float v = kernel._radius - distance;
+            return -v * kernel._gradient;
+        }
+        return 0.0f;
+    }
+};
+
+// 15 / (pi h^6) (h - r)^3, or 10 / (pi h^5) (h - r)^3 in 2D. The near density kernel that keeps
+// particles from clumping.
+template <int Dimensions> struct SpikyPow3Kernel {
+    static constexpr int DIMENSIONS = Dimensions;
+
+    static constexpr KernelCoefficients coefficients(const float radius)
+    {
+        using smoothing_kernels::power;
+        if constexpr (Dimensions == 2) {
+            return { radius, 1.0f / radius, static_cast<float>(10.0f / (PI * power(radius, 5))),
+                static_cast<float>(30.0f / (PI * power(radius, 5))) };
+        }
+        return { radius, 1.0f / radius, static_cast<float>(15.0f / (PI * power(radius, 6))),
+            static_cast<float>(45.0f / (PI * power(radius, 6))) };
+    }
+
+    static constexpr float value(const KernelCoefficients& kernel, const float distance)
+    {
+        if (distance < kernel._radius) {
+            const float v = kernel._radius - distance;
+            return v * v * v * kernel._value;
+        }
+        return 0.0f;
+    }
+
+    static constexpr float derivative(const KernelCoefficients& kernel, const float distance)
+    {
+        if (distance <= kernel._radius) {
+            const float v = kernel._radius - distance;
+            return -v * v * kernel._gradient;
+        }
+        return 0.0f;
+    }
+};
+
+// 315 / (64 pi h^9) (h^2 - r^2)^3, or 4 / (pi h^8) (h^2 - r^2)^3 in 2D.
+template <int Dimensions> struct Poly6Kernel {
+    static constexpr int DIMENSIONS = Dimensions;
+
+    static constexpr KernelCoefficients coefficients(const float radius)
+    {
+        using smoothing_kernels::power;
+        if constexpr (Dimensions == 2) {
+            return { radius, 1.0f / radius, static_cast<float>(4.0f / (PI * power(radius, 8))),
+                static_cast<float>(24.0f / (PI * power(radius, 8))) };
+        }
+        return { radius, 1.0f / radius,
+            static_cast<float>(315.0f / (64.0f * PI * power(radius, 9))),
+            static_cast<float>(945.0f / (32.0f * PI * power(radius, 9))) };
+    }
+
+    static constexpr float value(const KernelCoefficients& kernel, const float distance)
+    {
+        if (const float h = kernel._radius; distance < h) {
+            const float v = h * h - distance * distance;
+            return v * v * v * kernel._value;
+        }
+        return 0.0f;
+    }
+
+    static constexpr float derivative(const KernelCoefficients& kernel, const float distance)
+    {
+        if (const float h = kernel._radius; distance <= h) {
+            const float v = h * h - distance * distance;
+            return -distance * v * v * kernel._gradient;
+        }
+        return 0.0f;
+    }
+};
+
+// 8 / (pi h^3) times 1 - 6q^2 + 6q^3 up to q = 1/2 and 2 (1 - q)^3 beyond, with q = r / h. In 2D
+// the factor is 40 / (7 pi h^2).
+template <int Dimensions> struct CubicSplineKernel {
+    static constexpr int DIMENSIONS = Dimensions;
+
+    static constexpr KernelCoefficients coefficients(const float radius)
+    {
+        using smoothing_kernels::power;
+        if constexpr (Dimensions == 2) {
+            return { radius, 1.0f / radius,
+                static_cast<float>(40.0f / (7.0f * PI * power(radius, 2))),
+                static_cast<float>(40.0f / (7.0f * PI * power(radius, 3))) };
+        }
+        return { radius, 1.0f / radius, static_cast<float>(8.0f / (PI * power(radius, 3))),
+            static_cast<float>(8.0f / (PI * power(radius, 4))) };
+    }
+
+    static constexpr float value(const KernelCoefficients& kernel, const float distance)
+    {
+        const float q = distance * kernel._inverseRadius;
+        if (q <= 0.5f)
+            return (1.0f + 6.0f * q * q * (q - 1.0f)) * kernel._value;
+        if (q < 1.0f) {
+            const float v = 1.0f - q;
+            return 2.0f * v * v * v * kernel._value;
+        }
+        return 0.0f;
+    }
+
+    static constexpr float derivative(const KernelCoefficients& kernel, const float distance)
+    {
+        const float q = distance * kernel._inverseRadius;
+        if (q <= 0.5f)
+            return 6.0f * q * (3.0f * q - 2.0f) * kernel._gradient;
+        if (q < 1.0f) {
+            const float v = 1.0f - q;
+            return -6.0f * v * v * kernel._gradient;
+        }
+        return 0.0f;
+    }
+};
+
+// 21 / (2 pi h^3) (1 - q)^4 (1 + 4q), with q = r / h. In 2D the factor is 7 / (pi h^2).
+template <int Dimensions> struct WendlandC2Kernel {
+    static constexpr int DIMENSIONS = Dimensions;
+
+    static constexpr KernelCoefficients coefficients(const float radius)
+    {
+        using smoothing_kernels::power;
+        if constexpr (Dimensions == 2) {
+            return { radius, 1.0f / radius, static_cast<float>(7.0f / (PI * power(radius, 2))),
+                static_cast<float>(7.0f / (PI * power(radius, 3))) };
+        }
+        return { radius, 1.0f / radius, static_cast<float>(21.0f / (2.0f * PI * power(radius, 3))),
+            static_cast<float>(21.0f / (2.0f * PI * power(radius, 4))) };
+    }
+
+    static constexpr float value(const KernelCoefficients& kernel, const float distance)
+    {
+        if (const float q = distance * kernel._inverseRadius; q < 1.0f) {
+            const float v = 1.0f - q;
+            const float squareV = v * v;
+            return squareV * squareV * (1.0f + 4.0f * q) * kernel._value;
+        }
+        return 0.0f;
+    }
+
+    static constexpr float derivative(const KernelCoefficients& kernel, const float distance)
+    {
+        if (const float q = distance * kernel._inverseRadius; q < 1.0f) {
+            const float v = 1.0f - q;
+            return -20.0f * q * v * v * v * kernel._gradient;
+        }
+        return 0.0f;
+    }
+};
+
+/** Call a visitor with a value of the policy type for a kernel shape, so the shape is picked once
+ * and code templated on the policy runs without branching on it per neighbor.
+ * @param kernel The kernel shape.
+ * @param visit The generic callable invoked with a SpikyKernel, Poly6Kernel, CubicSplineKernel or
+ * WendlandC2Kernel of the given dimensions.
+ * @return Whatever the visitor returns.
+ */
+template <int Dimensions, typename Visitor>
+decltype(auto) withSmoothingKernel(const SmoothingKernel kernel, Visitor&& visit)
+{
+    switch (kernel) {
+    case SmoothingKernel::Poly6:
+        return visit(Poly6Kernel<Dimensions> {});
+    case SmoothingKernel::CubicSpline:
+        return visit(CubicSplineKernel<Dimensions> {});
+    case SmoothingKernel::WendlandC2:
+        return visit(WendlandC2Kernel<Dimensions> {});
+    case SmoothingKernel::Spiky:
+    default:
+        return visit(SpikyKernel<Dimensions> {});
+    }
+}
+
+/** Call a visitor with the policy type for a kernel shape and a number of dimensions.
+ * @param kernel The kernel shape.
+ * @param dimensions 2 or 3; anything but 2 is taken as 3.
+ * @param visit The generic callable invoked with the policy.
+ * @return Whatever the visitor returns.
+ */
+template <typename Visitor>
+decltype(auto) withSmoothingKernel(
+    const SmoothingKernel kernel, const int dimensions, Visitor&& visit)
+{
+    if (dimensions == 2)
+        return withSmoothingKernel<2>(kernel, std::forward<Visitor>(visit));
+    return withSmoothingKernel<3>(kernel, std::forward<Visitor>(visit));
+}
+
+#endif // SMOOTHINGKERNELS_H
@@ -0,0 +1,32 @@
+#ifndef SPACEFILLINGCURVES_H
+#define SPACEFILLINGCURVES_H
+
+#include "Math/Vec.h"
+#include <cstdint>
+
+/*
+ * Space-filling curves that order grid cells so cells close in space get close indices. Both map
+ * the 2^bits cells along each of the first `dimensions` axes one to one onto the indices below
+ * 2^(dimensions * bits); coordinates are taken modulo 2^bits.
+ */
+
+/**
+ * Get the Morton (Z-order) index of a cell, its coordinates' bits interleaved.
+ * @param cell The cell coordinates; only the first `dimensions` are used.
+ * @param bits Bits per axis, at most 10 in 3D and 16 in 2D.
+ * @param dimensions 2 or 3.
+ * @return The index, below 2^(dimensions * bits).
+ */
+uint32_t mortonIndex(const Vec3<int>& cell, uint32_t bits, int dimensions);
+
+/**
+ * Get the Hilbert index of a cell. Unlike Morton order, consecutive indices are always adjacent
+ * cells.
+ * @param cell The cell coordinates; only the first `dimensions` are used.
+ * @param bits Bits per axis, at least 1 and at most 10 in 3D and 16 in 2D.
+ * @param dimensions 2 or 3.
+ * @return The index, below 2^(dimensions * bits).
+ */
+uint32_t hilbertIndex(const Vec3<int>& cell, uint32_t bits, int dimensions);
+
+#endif // SPACEFILLINGCURVES_H
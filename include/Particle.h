@@ -5,24 +5,14 @@
 #ifndef PARTICLE_H
 #define PARTICLE_H
 #include <Math/Vec.h>
-#include <UI/Mesh.h>
-#include <cstdint>
 
 /**
  * Represents a single particle in the SPH simulation.
- * Contains position, velocity, density, and other properties.
- * Provides methods for drawing the particle using OpenGL.
+ * Contains position, velocity, density, and other properties. It has no OpenGL dependency;
+ * drawing is done by ParticleRenderer.
  */
 class Particle {
 public:
-    /**
-     * Initializes the static mesh used for rendering particles.
-     * Should be called once before creating any Particle instances.
-     *
-     * @param shader The OpenGL shader program to use for rendering the particles.
-     */
-    static void init(uint32_t shader);
-
     Particle() = default;
 
     /**
@@ -34,9 +24,12 @@ public:
     Particle(Vec3<float> position, Vec3<float> velocity);
 
     /**
-     * Draws the particle using the provided shader program.
+     * Computes the display color of a particle from its speed.
+     *
+     * @param velocity The velocity of the particle.
+     * @return The RGB color, from blue when slow to red when fast.
      */
-    void draw() const;
+    static Vec3<float> color(const Vec3<float>& velocity);
 
     /**
      * Checks if this particle is the same as another particle (i.e., they are the same instance).
@@ -51,11 +44,6 @@ public:
     Vec3<float> _velocity {};
     float _density = 0.0f; // Density based on the smoothing kernel
     float _nearDensity = 0.0f; // Near density for pressure calculations
-
-private:
-    static float _radius;
-    static uint32_t _shader;
-    static Mesh _mesh;
 };
 
 #endif // PARTICLE_H
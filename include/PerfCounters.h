@@ -0,0 +1,62 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <array>
+#include <cstdint>
+#include <thread>
+
+/*
+ * Hardware event counts over some span of execution. LLC misses are the generic cache miss event,
+ * which the kernel maps to last level cache misses on common CPUs.
+ */
+struct CounterValues {
+    uint64_t _cycles = 0;
+    uint64_t _instructions = 0;
+    uint64_t _cacheMisses = 0;
+    uint64_t _branchMisses = 0;
+
+    CounterValues& operator+=(const CounterValues& other);
+    CounterValues operator-(const CounterValues& other) const;
+};
+
+/**
+ * Hardware performance counters of one thread, read through Linux perf_event_open. The counters
+ * are opened as one group so they always count over the same intervals, and only count user space
+ * so they work at the default perf_event_paranoid level. On other platforms, or when the kernel or
+ * the machine does not expose the counters, open fails and nothing is counted.
+ */
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    /**
+     * Start counting the calling thread, closing any counters opened before.
+     * @return False if the counters are not available.
+     */
+    bool open();
+
+    /**
+     * Get whether the counters are open and count the calling thread.
+     * @return True after a successful open on the same thread.
+     */
+    [[nodiscard]] bool countsCallingThread() const;
+
+    /**
+     * Read the counts accumulated since open.
+     * @param values Set to the current counts.
+     * @return False if the counters are not open or could not be read.
+     */
+    bool read(CounterValues& values) const;
+
+private:
+    void close();
+
+    std::array<int, 4> _fds { -1, -1, -1, -1 }; // Group leader first
+    std::thread::id _thread;
+};
+
+#endif // PERFCOUNTERS_H
@@ -18,8 +18,10 @@ inline float toRadians(const float degrees) noexcept
     return degrees * static_cast<float>(PI) / 180.0f;
 }
 
-inline std::vector<Particle> spawnParticlesInBox(
-    const size_t count, const float boxSize, const float margin, const float minHeightRatio)
+// Scatter particles at rest uniformly through the upper part of a box centered on the origin.
+// Pass a seed to get the same particles every time.
+inline std::vector<Particle> spawnParticlesInBox(const size_t count, const float boxSize,
+    const float margin, const float minHeightRatio, const unsigned seed = std::random_device {}())
 {
     std::vector<Particle> particles;
     particles.reserve(count);
@@ -32,8 +34,7 @@ inline std::vector<Particle> spawnParticlesInBox(
         minY = maxY;
     }
 
-    std::random_device rd;
-    std::mt19937 rng(rd());
+    std::mt19937 rng(seed);
     std::uniform_real_distribution<float> xDist(-halfBox + clampedMargin, halfBox - clampedMargin);
     std::uniform_real_distribution<float> yDist(minY, maxY);
     std::uniform_real_distribution<float> zDist(-halfBox + clampedMargin, halfBox - clampedMargin);
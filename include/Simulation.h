@@ -0,0 +1,167 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "Math/SPH.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Particle state published by the simulation thread after a step. Positions and colors are packed
+ * three floats per particle, ready to hand to the renderer. They point either into the snapshot's
+ * own storage or into external memory set with Simulation::setSnapshotStorage.
+ */
+struct SimulationSnapshot {
+    float* _positions = nullptr;
+    float* _colors = nullptr;
+    uint32_t _slot = 0; // Index of the triple buffer slot holding this snapshot
+    size_t _particleCount = 0;
+    uint64_t _step = 0; // Number of steps taken when the snapshot was published
+    float _stepTime = 0.0f; // Wall time of the step in milliseconds
+    int _substeps = 0; // Substeps the step was split into
+    float _timestep = 0.0f; // Simulated time of the last substep in seconds
+    int _pressureIterations = 0; // Implicit solver iterations of the last substep, 0 without it
+    float _densityError = 0.0f; // Mean compression the implicit solver left, over targetDensity
+    SimdLevel _simdLevel = SimdLevel::Scalar; // Instruction set of the neighbor kernels
+    float _stepsPerSecond = 0.0f; // Measured simulation rate
+    std::vector<float> _idleTimes; // Barrier wait per worker thread in milliseconds
+    std::vector<PhaseTimes> _phaseTimes; // Work and wait per phase for each worker thread
+    std::vector<float> _storage; // Backing memory when no external storage is set
+};
+
+/**
+ * Singleton that runs the SPH simulation on its own thread, decoupled from the render loop. Every
+ * step is published into a triple buffer, so the renderer always reads the latest complete
+ * snapshot without waiting for the simulation, and config changes from the UI are applied
+ * between steps.
+ */
+class Simulation {
+public:
+    /**
+     * Get the singleton instance of the Simulation class.
+     * @return Reference to the Simulation instance.
+     */
+    static Simulation& getInstance();
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+    Simulation(Simulation&&) = delete;
+    Simulation& operator=(Simulation&&) = delete;
+
+    /**
+     * Start stepping the simulation on a background thread. SPH must already be initialized.
+     */
+    void start();
+
+    /**
+     * Stop the simulation thread and wait for the current step to finish.
+     */
+    void stop();
+
+    /**
+     * Let the snapshots write their particles straight into external memory, such as a
+     * persistently mapped GPU buffer. Must be called before start; slots too small for the
+     * particle count fall back to internal storage.
+     * @param positions The position buffer of each slot.
+     * @param colors The color buffer of each slot.
+     * @param capacity The number of particles each buffer can hold.
+     */
+    void setSnapshotStorage(const std::array<float*, 3>& positions,
+        const std::array<float*, 3>& colors, size_t capacity);
+
+    /**
+     * Set a function called by acquireSnapshot before a slot is handed back to the simulation
+     * thread, so the renderer can wait until the GPU no longer reads from it.
+     * @param handler The function receiving the slot index.
+     */
+    void setReleaseHandler(std::function<void(uint32_t slot)> handler);
+
+    /**
+     * Get the latest snapshot published by the simulation thread. Only the render thread may call
+     * this; the returned snapshot stays valid until the next call.
+     * @return The most recent complete snapshot.
+     */
+    const SimulationSnapshot& acquireSnapshot();
+
+    /**
+     * Get the snapshot returned by the last acquireSnapshot call.
+     * @return The snapshot currently held by the render thread.
+     */
+    [[nodiscard]] const SimulationSnapshot& snapshot() const;
+
+    /**
+     * Request a new simulation configuration. It is applied before the next step.
+     * @param config The new configuration to apply to the simulation.
+     */
+    void setConfig(const SPHConfig& config);
+
+    /**
+     * Get the most recently requested simulation configuration.
+     * @return A copy of the configuration.
+     */
+    [[nodiscard]] SPHConfig config() const;
+
+    /**
+     * Set how many steps per second the simulation thread aims for.
+     * @param stepsPerSecond The target rate, or 0 to step as fast as possible.
+     */
+    void setTargetStepsPerSecond(float stepsPerSecond);
+
+    /**
+     * Get the target simulation rate.
+     * @return The target steps per second, 0 when unlimited.
+     */
+    [[nodiscard]] float targetStepsPerSecond() const;
+
+private:
+    Simulation() = default;
+    ~Simulation();
+
+    /**
+     * Loop executed by the simulation thread: apply pending config, step, publish, then wait for
+     * the next step's slot when a target rate is set.
+     */
+    void run();
+
+    /**
+     * Copy the solver's particles into the write buffer. Steps write them directly through the
+     * solver's instance sink, so this is only needed for the initial snapshot.
+     */
+    void copyParticles();
+
+    /**
+     * Fill in the step statistics of the write buffer and hand it to the reader.
+     */
+    void publish();
+
+    std::thread _thread;
+    std::atomic<bool> _running { false };
+    std::atomic<float> _targetStepsPerSecond { 60.0f };
+
+    // Requested config, written by the UI and applied by the simulation thread.
+    mutable std::mutex _configMutex;
+    SPHConfig _config;
+    bool _configPending = false;
+
+    // Triple buffer: the writer and the reader each own one snapshot, and the third is exchanged
+    // through _ready, whose FRESH bit marks a snapshot the reader has not picked up yet.
+    static constexpr uint32_t FRESH = 4;
+    std::array<SimulationSnapshot, 3> _snapshots;
+    std::array<float*, 3> _externalPositions {};
+    std::array<float*, 3> _externalColors {};
+    size_t _externalCapacity = 0;
+    std::function<void(uint32_t slot)> _releaseHandler;
+    std::atomic<uint32_t> _ready { 1 };
+    uint32_t _writeIndex = 0;
+    uint32_t _readIndex = 2;
+
+    uint64_t _stepCount = 0;
+    float _stepsPerSecond = 0.0f;
+};
+
+#endif // SIMULATION_H
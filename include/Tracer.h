@@ -0,0 +1,151 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Singleton that records timed events from every thread into a Chrome trace-event JSON file, which
+ * chrome://tracing and ui.perfetto.dev display as one timeline per thread. Each thread writes into
+ * its own single-producer ring buffer without locking, and a background thread drains the rings
+ * into the file while tracing runs. Events that find their ring full are dropped, never waited on.
+ */
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Get the singleton instance of the Tracer class.
+     * @return Reference to the Tracer instance.
+     */
+    static Tracer& getInstance();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+    Tracer(Tracer&&) = delete;
+    Tracer& operator=(Tracer&&) = delete;
+
+    /**
+     * Start recording events into a new trace file. Does nothing while already recording.
+     * @param path The file to write the trace to.
+     * @return False if the file could not be opened.
+     */
+    bool start(const std::string& path);
+
+    /**
+     * Stop recording, write out the remaining events and close the file.
+     */
+    void stop();
+
+    /**
+     * Get whether events are being recorded.
+     * @return True between start and stop.
+     */
+    [[nodiscard]] bool enabled() const;
+
+    /**
+     * Record an event on the calling thread. Does nothing unless tracing is enabled.
+     * @param name The event name. Must be a string that outlives the trace, such as a literal.
+     * @param category The event category, with the same lifetime requirement as the name.
+     * @param begin When the event began.
+     * @param end When the event ended.
+     */
+    void record(const char* name, const char* category, Clock::time_point begin,
+        Clock::time_point end);
+
+    /**
+     * Set the name the calling thread is shown under in traces, and register its buffer. Call it
+     * when the thread starts: a thread that never does allocates its buffer on its first event.
+     * @param name The thread name.
+     */
+    static void setThreadName(std::string name);
+
+private:
+    struct Event {
+        const char* _name;
+        const char* _category;
+        int64_t _begin; // Nanoseconds on Clock
+        int64_t _end;
+    };
+
+    // Single-producer, single-consumer ring owned by one thread. The thread only writes _head and
+    // the drain only writes _tail, each on its own cache line.
+    struct Buffer {
+        static constexpr uint64_t CAPACITY = 1 << 14;
+
+        std::vector<Event> _events = std::vector<Event>(CAPACITY);
+        alignas(64) std::atomic<uint64_t> _head { 0 };
+        alignas(64) std::atomic<uint64_t> _tail { 0 };
+        std::atomic<uint64_t> _dropped { 0 };
+        std::atomic<bool> _retired { false }; // Set when the owning thread exits
+        std::string _threadName;
+        uint32_t _threadId = 0;
+        bool _named = false; // Whether the trace has the thread's name yet
+    };
+
+    Tracer() = default;
+    ~Tracer();
+
+    /**
+     * Get the calling thread's buffer, creating and registering it on first use.
+     * @return The thread's buffer.
+     */
+    Buffer& threadBuffer();
+
+    /**
+     * Loop executed by the drain thread: write out every buffer's events until tracing stops.
+     */
+    void drainLoop();
+
+    /**
+     * Write every buffer's pending events to the file and forget buffers of exited threads.
+     * Only called by one thread at a time.
+     */
+    void drain();
+
+    std::atomic<bool> _enabled { false };
+    std::thread _drainThread;
+    std::ofstream _file;
+    Clock::time_point _startTime;
+    bool _firstEvent = true;
+
+    std::mutex _buffersMutex; // Guards _buffers, which threads append to on their first event
+    std::vector<std::shared_ptr<Buffer>> _buffers;
+    uint32_t _nextThreadId = 1;
+};
+
+/**
+ * Records an event covering its own lifetime on the calling thread, when tracing is enabled.
+ */
+class TraceScope {
+public:
+    /**
+     * Start the event.
+     * @param name The event name. Must be a string that outlives the trace, such as a literal.
+     * @param category The event category, with the same lifetime requirement as the name.
+     */
+    TraceScope(const char* name, const char* category);
+
+    /**
+     * End the event and record it.
+     */
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* _name;
+    const char* _category;
+    Tracer::Clock::time_point _begin;
+    bool _active;
+};
+
+#endif // TRACER_H
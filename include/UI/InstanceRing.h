@@ -0,0 +1,100 @@
+#ifndef INSTANCERING_H
+#define INSTANCERING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+struct __GLsync;
+
+/**
+ * Persistently mapped GPU buffer split into three slots of particle instance data, one per
+ * simulation snapshot. The simulation writes a slot directly through the mapping while the GPU
+ * draws from another; a fence per slot keeps the CPU from overwriting a slot the GPU still reads.
+ * Each slot holds the positions of every particle, followed by their colors.
+ */
+class InstanceRing {
+public:
+    static constexpr uint32_t SLOT_COUNT = 3;
+
+    InstanceRing() = default;
+    ~InstanceRing();
+
+    InstanceRing(const InstanceRing&) = delete;
+    InstanceRing& operator=(const InstanceRing&) = delete;
+
+    /**
+     * Create and map the buffer. Requires ARB_buffer_storage (core in OpenGL 4.4).
+     * @param capacity The number of particles each slot holds.
+     * @return False if persistent mapping is unavailable; callers then upload through orphaned
+     * buffers instead.
+     */
+    bool init(size_t capacity);
+
+    /**
+     * Check whether the ring was created and mapped.
+     * @return True if init succeeded.
+     */
+    [[nodiscard]] bool ready() const;
+
+    /**
+     * Get the mapped position block of a slot.
+     * @param slot The slot index.
+     * @return Pointer to three floats per particle.
+     */
+    [[nodiscard]] float* positions(uint32_t slot) const;
+
+    /**
+     * Get the mapped color block of a slot.
+     * @param slot The slot index.
+     * @return Pointer to three floats per particle.
+     */
+    [[nodiscard]] float* colors(uint32_t slot) const;
+
+    /**
+     * Get the byte offset of a slot's position block in the buffer.
+     * @param slot The slot index.
+     * @return The offset in bytes.
+     */
+    [[nodiscard]] size_t positionOffset(uint32_t slot) const;
+
+    /**
+     * Get the byte offset of a slot's color block in the buffer.
+     * @param slot The slot index.
+     * @return The offset in bytes.
+     */
+    [[nodiscard]] size_t colorOffset(uint32_t slot) const;
+
+    /**
+     * Get the buffer object holding all slots.
+     * @return The OpenGL buffer name.
+     */
+    [[nodiscard]] uint32_t buffer() const;
+
+    /**
+     * Get the number of particles each slot holds.
+     * @return The slot capacity.
+     */
+    [[nodiscard]] size_t capacity() const;
+
+    /**
+     * Mark the point in the command stream after which the GPU is done reading a slot. Call after
+     * issuing the draws that read it.
+     * @param slot The slot index.
+     */
+    void fence(uint32_t slot);
+
+    /**
+     * Block until the GPU has finished the commands fenced for a slot, so it can be rewritten.
+     * @param slot The slot index.
+     */
+    void wait(uint32_t slot);
+
+private:
+    uint32_t _buffer = 0;
+    float* _mapped = nullptr;
+    size_t _capacity = 0;
+    std::array<__GLsync*, SLOT_COUNT> _fences {};
+};
+
+#endif // INSTANCERING_H
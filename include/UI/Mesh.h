@@ -27,6 +27,22 @@ public:
      * draw call based on the primitive type and vertex count. */
     void draw() const;
 
+    /**
+     * Read a per-instance vec3 attribute from another buffer. The attribute advances once per
+     * instance instead of once per vertex.
+     * @param location The attribute location in the shader.
+     * @param buffer The buffer holding one vec3 of floats per instance.
+     * @param offset The byte offset of the first instance's value in the buffer.
+     */
+    void setInstanceAttribute(uint32_t location, uint32_t buffer, size_t offset) const;
+
+    /**
+     * Draw the mesh once per instance in a single draw call, using the currently bound shader
+     * program and the attributes set with setInstanceAttribute.
+     * @param instanceCount The number of instances to draw.
+     */
+    void drawInstanced(int instanceCount) const;
+
 private:
     uint32_t _vao = 0; // Vertex Array Object ID
     uint32_t _vbo = 0; // Vertex Buffer Object ID
@@ -37,6 +53,7 @@ private:
 namespace MeshFactory {
 
 Mesh createSphere(float radius, int rings = 16, int segments = 24);
+Mesh createQuad(float halfSize);
 Mesh createBox(const Vec3<float>& halfSize);
 
 } // namespace MeshFactory
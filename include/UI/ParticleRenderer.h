@@ -0,0 +1,77 @@
+#ifndef PARTICLERENDERER_H
+#define PARTICLERENDERER_H
+
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * How particles are drawn: as sphere meshes, or as camera-facing quads that ray trace a sphere in
+ * the fragment shader.
+ */
+enum class ParticleStyle { Mesh, Impostor };
+
+/**
+ * Draws the simulation's particles with OpenGL. Kept apart from Particle so the solver builds
+ * without a GL context or windowing library.
+ */
+class ParticleRenderer {
+public:
+    /**
+     * Initializes the static mesh and instance buffer used for rendering particles.
+     * Should be called once after the GL context is created.
+     */
+    static void init();
+
+    /**
+     * Draws all particles with one instanced draw call. Positions and colors are uploaded to the
+     * instance buffer and read by the bound shader at attribute locations 1 and 2.
+     *
+     * @param positions The particle positions, three floats per particle.
+     * @param colors The RGB particle colors, three floats per particle.
+     * @param count The number of particles to draw.
+     * @param style Draw sphere meshes or impostor quads; the bound shader must match.
+     */
+    static void draw(
+        const float* positions, const float* colors, size_t count, ParticleStyle style);
+
+    /**
+     * Draws all particles with one instanced draw call, reading instance data that is already in
+     * a GPU buffer.
+     *
+     * @param buffer The buffer holding the instance data.
+     * @param positionOffset The byte offset of the positions, three floats per particle.
+     * @param colorOffset The byte offset of the colors, three floats per particle.
+     * @param count The number of particles to draw.
+     * @param style Draw sphere meshes or impostor quads; the bound shader must match.
+     */
+    static void draw(uint32_t buffer, size_t positionOffset, size_t colorOffset, size_t count,
+        ParticleStyle style);
+
+    /**
+     * Gets the radius particles are drawn with.
+     *
+     * @return The particle radius.
+     */
+    static float radius();
+
+private:
+    // Buffer and offsets a mesh's instance attributes currently read from.
+    struct InstanceBinding {
+        uint32_t _buffer = 0;
+        size_t _positionOffset = 0;
+        size_t _colorOffset = 0;
+
+        bool operator==(const InstanceBinding&) const = default;
+    };
+
+    static float _radius;
+    static Mesh _mesh;
+    static Mesh _impostorMesh; // Unit quad scaled and oriented in the impostor vertex shader
+    static uint32_t _instanceBuffer; // Positions for _instanceCapacity particles, then colors
+    static size_t _instanceCapacity;
+    static InstanceBinding _meshBinding;
+    static InstanceBinding _impostorBinding;
+};
+
+#endif // PARTICLERENDERER_H
@@ -0,0 +1,89 @@
+#ifndef PROFILERPANEL_H
+#define PROFILERPANEL_H
+
+#include "Math/SPH.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SimulationSnapshot;
+
+/**
+ * Singleton ImGui window showing where the simulation step spends its time. Keeps a rolling
+ * history of every phase's wall time, drawn as graphs next to its median and 99th percentile, and
+ * breaks the latest step down into work and barrier wait per worker thread. Also shows hardware
+ * counters per phase when they are enabled, and starts and stops trace recording.
+ */
+class ProfilerPanel {
+public:
+    /**
+     * Get the singleton instance of the ProfilerPanel class.
+     * @return Reference to the ProfilerPanel instance.
+     */
+    static ProfilerPanel& getInstance();
+
+    ProfilerPanel(const ProfilerPanel&) = delete;
+    ProfilerPanel& operator=(const ProfilerPanel&) = delete;
+    ProfilerPanel(ProfilerPanel&&) = delete;
+    ProfilerPanel& operator=(ProfilerPanel&&) = delete;
+
+    /**
+     * Add the snapshot's phase times to the history if it holds a step not seen before, then draw
+     * the window if it is visible.
+     * @param snapshot The snapshot currently held by the render thread.
+     */
+    void draw(const SimulationSnapshot& snapshot);
+
+    /**
+     * Get whether the window is shown. The window's close button clears it.
+     * @return Reference to the visibility flag, for use with a checkbox.
+     */
+    bool& visible();
+
+private:
+    static constexpr size_t HISTORY_SIZE = 240;
+    static constexpr const char* TRACE_PATH = "sph_trace.json";
+    using History = std::array<float, HISTORY_SIZE>;
+
+    ProfilerPanel() = default;
+    ~ProfilerPanel() = default;
+
+    /**
+     * Append one step's phase times to the history.
+     * @param snapshot The snapshot holding the step.
+     */
+    void record(const SimulationSnapshot& snapshot);
+
+    /**
+     * Get a percentile of a rolling history.
+     * @param history The history samples, in ring order.
+     * @param fraction The percentile as a fraction, 0.5 for the median.
+     * @return The sample at that percentile.
+     */
+    float percentile(const History& history, float fraction);
+
+    /**
+     * Draw the button that starts and stops recording a trace to TRACE_PATH.
+     */
+    void drawTraceControls();
+
+    /**
+     * Draw the toggle for hardware counters and, when the snapshot has them, the IPC and misses
+     * per particle of every phase of its step.
+     * @param snapshot The snapshot currently held by the render thread.
+     */
+    static void drawCounters(const SimulationSnapshot& snapshot);
+
+    // Wall time of each phase per recorded step in milliseconds, indexed by SPHPhase. The Step
+    // row holds the whole step.
+    std::array<History, PHASE_COUNT> _history {};
+    size_t _historyCount = 0; // Samples recorded so far, up to HISTORY_SIZE
+    size_t _historyNext = 0; // Ring position of the next sample, also the oldest one when full
+    uint64_t _lastStep = UINT64_MAX;
+    std::vector<float> _sorted; // Scratch buffer for percentiles
+    bool _visible = true;
+    bool _traceFailed = false; // Whether the trace file could not be opened
+};
+
+#endif // PROFILERPANEL_H
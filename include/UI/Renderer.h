@@ -2,8 +2,10 @@
 #define RENDERER_H
 
 #include "Camera.h"
+#include "InstanceRing.h"
 #include "Math/Vec.h"
 #include "Mesh.h"
+#include "ParticleRenderer.h"
 
 /**
  * Singleton class responsible for rendering the particles and the box.
@@ -33,6 +35,19 @@ public:
      */
     void draw();
 
+    /**
+     * Choose how particles are drawn. Impostors are the default; sphere meshes are kept as a
+     * fallback.
+     * @param style The particle style to draw with.
+     */
+    void setParticleStyle(ParticleStyle style);
+
+    /**
+     * Get how particles are drawn.
+     * @return The current particle style.
+     */
+    [[nodiscard]] ParticleStyle particleStyle() const;
+
 private:
     friend class Window;
     friend class Camera;
@@ -42,6 +57,9 @@ private:
 
     uint32_t _shaderProgram = 0;
     uint32_t _boxShaderProgram = 0;
+    uint32_t _impostorShaderProgram = 0;
+    ParticleStyle _particleStyle = ParticleStyle::Impostor;
+    InstanceRing _instanceRing; // Shared with the simulation when persistent mapping is available
     Mesh _boxMesh;
     Vec3<float> _boxHalfSize { 1.0f, 1.0f, 1.0f };
 
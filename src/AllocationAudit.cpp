@@ -0,0 +1,132 @@
+#include "AllocationAudit.h"
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace {
+// How many audited scopes the calling thread is inside. Plain data, so reading it from operator
+// new never allocates thread local storage.
+thread_local int scopeDepth = 0;
+} // namespace
+
+AllocationAudit& AllocationAudit::getInstance()
+{
+    // Constant initialized, so operator new can use it before main.
+    static AllocationAudit instance;
+    return instance;
+}
+
+bool AllocationAudit::available()
+{
+#ifdef SPH_ALLOCATION_AUDIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocationAudit::arm(const bool armed)
+{
+    _armed.store(armed, std::memory_order_release);
+}
+
+bool AllocationAudit::armed() const
+{
+    return _armed.load(std::memory_order_acquire);
+}
+
+uint64_t AllocationAudit::allocations() const
+{
+    return _allocations.load(std::memory_order_relaxed);
+}
+
+void AllocationAudit::noteAllocation()
+{
+    if (scopeDepth == 0)
+        return;
+
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    if (_armed.load(std::memory_order_relaxed)) {
+        // stderr is unbuffered, so this reports without allocating.
+        std::fputs("Heap allocation inside an audited scope\n", stderr);
+        std::abort();
+    }
+}
+
+AllocationScope::AllocationScope()
+{
+    ++scopeDepth;
+}
+
+AllocationScope::~AllocationScope()
+{
+    --scopeDepth;
+}
+
+#ifdef SPH_ALLOCATION_AUDIT
+// Replacements for the global allocation functions. The array and nothrow forms of the standard
+// library call these, so replacing the plain and aligned forms counts every allocation.
+namespace {
+void* allocate(std::size_t size, const std::size_t alignment)
+{
+    AllocationAudit::getInstance().noteAllocation();
+    if (size == 0)
+        size = 1;
+    void* pointer = nullptr;
+    if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        pointer = std::malloc(size);
+    } else {
+#ifdef _MSC_VER
+        pointer = _aligned_malloc(size, alignment);
+#else
+        // aligned_alloc wants a multiple of the alignment.
+        pointer = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    }
+    if (!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void release(void* pointer, [[maybe_unused]] const std::size_t alignment) noexcept
+{
+#ifdef _MSC_VER
+    if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+        _aligned_free(pointer);
+        return;
+    }
+#endif
+    std::free(pointer);
+}
+} // namespace
+
+void* operator new(const std::size_t size)
+{
+    return allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment)
+{
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+    release(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    release(pointer, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void operator delete(void* pointer, const std::align_val_t alignment) noexcept
+{
+    release(pointer, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer, std::size_t, const std::align_val_t alignment) noexcept
+{
+    release(pointer, static_cast<std::size_t>(alignment));
+}
+#endif
@@ -0,0 +1,81 @@
+#include "Math/BlockScheduler.h"
+#include <algorithm>
+
+namespace {
+uint64_t packRange(const uint32_t front, const uint32_t back)
+{
+    return static_cast<uint64_t>(back) << 32 | front;
+}
+} // namespace
+
+void BlockScheduler::init(const size_t threadCount)
+{
+    _threadCount = threadCount;
+    _runs = std::make_unique<Run[]>(threadCount);
+}
+
+void BlockScheduler::reset(const size_t itemCount, const size_t blockSize)
+{
+    _itemCount = itemCount;
+    _blockSize = std::max<size_t>(1, blockSize);
+
+    // Deal the blocks out in contiguous runs so a thread that is never stolen from keeps the same
+    // particles as a static partition would.
+    const size_t blockCount = (itemCount + _blockSize - 1) / _blockSize;
+    const size_t perThread = (blockCount + _threadCount - 1) / _threadCount;
+    for (size_t thread = 0; thread < _threadCount; ++thread) {
+        const auto front = static_cast<uint32_t>(std::min(thread * perThread, blockCount));
+        const auto back = static_cast<uint32_t>(std::min(front + perThread, blockCount));
+        _runs[thread]._range.store(packRange(front, back), std::memory_order_relaxed);
+    }
+}
+
+bool BlockScheduler::next(const size_t thread, size_t& start, size_t& end)
+{
+    uint32_t block = 0;
+    bool found = takeFront(_runs[thread], block);
+
+    // Visit the other threads starting with the next one, so thieves spread over their victims.
+    for (size_t offset = 1; !found && offset < _threadCount; ++offset) {
+        found = takeBack(_runs[(thread + offset) % _threadCount], block);
+    }
+
+    if (!found)
+        return false;
+
+    start = static_cast<size_t>(block) * _blockSize;
+    end = std::min(start + _blockSize, _itemCount);
+    return true;
+}
+
+bool BlockScheduler::takeFront(Run& run, uint32_t& block)
+{
+    uint64_t range = run._range.load(std::memory_order_relaxed);
+    while (true) {
+        const auto front = static_cast<uint32_t>(range);
+        const auto back = static_cast<uint32_t>(range >> 32);
+        if (front >= back)
+            return false;
+        if (run._range.compare_exchange_weak(
+                range, packRange(front + 1, back), std::memory_order_relaxed)) {
+            block = front;
+            return true;
+        }
+    }
+}
+
+bool BlockScheduler::takeBack(Run& run, uint32_t& block)
+{
+    uint64_t range = run._range.load(std::memory_order_relaxed);
+    while (true) {
+        const auto front = static_cast<uint32_t>(range);
+        const auto back = static_cast<uint32_t>(range >> 32);
+        if (front >= back)
+            return false;
+        if (run._range.compare_exchange_weak(
+                range, packRange(front, back - 1), std::memory_order_relaxed)) {
+            block = back - 1;
+            return true;
+        }
+    }
+}
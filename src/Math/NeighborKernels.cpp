@@ -0,0 +1,89 @@
+#include "Math/NeighborKernels.h"
+
+#if defined(SPH_X86_KERNELS) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+#ifdef SPH_X86_KERNELS
+// Defined in the per instruction set sources, each compiled for its own target.
+const NeighborKernels& sse4NeighborKernels();
+const NeighborKernels& avx2NeighborKernels();
+const NeighborKernels& avx512NeighborKernels();
+#endif
+
+namespace {
+SimdLevel detectCpu()
+{
+#if defined(SPH_X86_KERNELS) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse4 = info[2] & (1 << 19);
+    const bool fma = info[2] & (1 << 12);
+    // The OS must also save the wider registers on context switches.
+    const bool osSavesAvx = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+    const bool osSavesAvx512 = osSavesAvx && (_xgetbv(0) & 0xe6) == 0xe6;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = info[1] & (1 << 5);
+        avx512 = info[1] & (1 << 16);
+    }
+    if (avx512 && osSavesAvx512)
+        return SimdLevel::AVX512;
+    if (avx2 && fma && osSavesAvx)
+        return SimdLevel::AVX2;
+    return sse4 ? SimdLevel::SSE4 : SimdLevel::Scalar;
+#elif defined(SPH_X86_KERNELS)
+    // These also check that the OS saves the wider registers.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::AVX2;
+    return __builtin_cpu_supports("sse4.1") ? SimdLevel::SSE4 : SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+} // namespace
+
+SimdLevel detectSimdLevel()
+{
+    static const SimdLevel level = detectCpu();
+    return level;
+}
+
+const NeighborKernels* neighborKernels(const SimdLevel level)
+{
+    switch (level) {
+#ifdef SPH_X86_KERNELS
+    case SimdLevel::SSE4:
+        return &sse4NeighborKernels();
+    case SimdLevel::AVX2:
+        return &avx2NeighborKernels();
+    case SimdLevel::AVX512:
+        return &avx512NeighborKernels();
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+const char* simdLevelName(const SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::SSE4:
+        return "SSE4.1";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::AVX512:
+        return "AVX-512";
+    case SimdLevel::Scalar:
+    default:
+        return "Scalar";
+    }
+}
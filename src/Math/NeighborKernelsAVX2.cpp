@@ -0,0 +1,52 @@
+#include "NeighborKernelsImpl.h"
+#include <immintrin.h>
+
+// Compiled with AVX2 and FMA enabled; only called after detectSimdLevel found them.
+
+namespace {
+struct Avx2Lanes {
+    using Float = __m256;
+    using Mask = __m256;
+    static constexpr uint32_t WIDTH = 8;
+
+    static Float broadcast(const float value) { return _mm256_set1_ps(value); }
+    static Float load(const float* values) { return _mm256_loadu_ps(values); }
+
+    // Masked loads never touch the lanes left out, so reading past the array is safe.
+    static Float loadPartial(const float* values, const uint32_t count)
+    {
+        return _mm256_maskload_ps(values, _mm256_castps_si256(firstLanes(count)));
+    }
+
+    static Mask firstLanes(const uint32_t count)
+    {
+        return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count)),
+            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    }
+
+    static Float add(const Float a, const Float b) { return _mm256_add_ps(a, b); }
+    static Float sub(const Float a, const Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(const Float a, const Float b) { return _mm256_mul_ps(a, b); }
+    static Float div(const Float a, const Float b) { return _mm256_div_ps(a, b); }
+    static Float max(const Float a, const Float b) { return _mm256_max_ps(a, b); }
+    static Float sqrt(const Float a) { return _mm256_sqrt_ps(a); }
+    static Mask less(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask lessEqual(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static Mask greater(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Mask both(const Mask a, const Mask b) { return _mm256_and_ps(a, b); }
+    static Float select(const Mask mask, const Float value) { return _mm256_and_ps(mask, value); }
+
+    static void store(float* values, const Float a) { _mm256_storeu_ps(values, a); }
+
+    static uint32_t bits(const Mask mask)
+    {
+        return static_cast<uint32_t>(_mm256_movemask_ps(mask));
+    }
+};
+} // namespace
+
+const NeighborKernels& avx2NeighborKernels()
+{
+    static constexpr NeighborKernels kernels = neighbor_kernels::kernels<Avx2Lanes>();
+    return kernels;
+}
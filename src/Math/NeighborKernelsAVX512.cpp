@@ -0,0 +1,62 @@
+#include "NeighborKernelsImpl.h"
+
+// GCC 12 warns about its own _mm512_undefined_ps inside the AVX-512 intrinsics.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+
+// Compiled with AVX-512F enabled; only called after detectSimdLevel found it.
+
+namespace {
+struct Avx512Lanes {
+    using Float = __m512;
+    using Mask = __mmask16;
+    static constexpr uint32_t WIDTH = 16;
+
+    static Float broadcast(const float value) { return _mm512_set1_ps(value); }
+    static Float load(const float* values) { return _mm512_loadu_ps(values); }
+
+    // Masked loads never touch the lanes left out, so reading past the array is safe.
+    static Float loadPartial(const float* values, const uint32_t count)
+    {
+        return _mm512_maskz_loadu_ps(firstLanes(count), values);
+    }
+
+    static Mask firstLanes(const uint32_t count)
+    {
+        return static_cast<Mask>(count >= WIDTH ? 0xffffu : (1u << count) - 1u);
+    }
+
+    static Float add(const Float a, const Float b) { return _mm512_add_ps(a, b); }
+    static Float sub(const Float a, const Float b) { return _mm512_sub_ps(a, b); }
+    static Float mul(const Float a, const Float b) { return _mm512_mul_ps(a, b); }
+    static Float div(const Float a, const Float b) { return _mm512_div_ps(a, b); }
+    static Float max(const Float a, const Float b) { return _mm512_max_ps(a, b); }
+    static Float sqrt(const Float a) { return _mm512_sqrt_ps(a); }
+    static Mask less(const Float a, const Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static Mask lessEqual(const Float a, const Float b)
+    {
+        return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ);
+    }
+    static Mask greater(const Float a, const Float b)
+    {
+        return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);
+    }
+    static Mask both(const Mask a, const Mask b) { return static_cast<Mask>(a & b); }
+    static Float select(const Mask mask, const Float value)
+    {
+        return _mm512_maskz_mov_ps(mask, value);
+    }
+
+    static void store(float* values, const Float a) { _mm512_storeu_ps(values, a); }
+    static uint32_t bits(const Mask mask) { return mask; }
+};
+} // namespace
+
+const NeighborKernels& avx512NeighborKernels()
+{
+    static constexpr NeighborKernels kernels = neighbor_kernels::kernels<Avx512Lanes>();
+    return kernels;
+}
@@ -0,0 +1,196 @@
+#ifndef NEIGHBORKERNELSIMPL_H
+#define NEIGHBORKERNELSIMPL_H
+
+#include "Math/NeighborKernels.h"
+
+/*
+ * The neighbor kernels, written once over a Lanes type that wraps one instruction set's
+ * intrinsics. Each per instruction set source defines its Lanes in an anonymous namespace and
+ * instantiates these with it, so every instantiation is local to a file compiled for its target.
+ * Nothing here may call into the standard library: an inline function compiled with wider
+ * instructions could be the copy the linker keeps for the rest of the program.
+ *
+ * Lanes provides Float and Mask types, WIDTH, and broadcast, load, loadPartial (zero past count),
+ * firstLanes (mask of the first count lanes), add, sub, mul, div, max, sqrt, less, lessEqual,
+ * greater, both (mask and), select (value where the mask is set, zero elsewhere), store and bits
+ * (one bit per lane of a mask, lowest lane first).
+ */
+namespace neighbor_kernels {
+// Set bits of a lane mask, without relying on a popcount instruction. Static, like lowestBit, so
+// each file keeps the copy compiled for its own target.
+static inline uint32_t countBits(uint32_t bits)
+{
+    uint32_t count = 0;
+    for (; bits; bits &= bits - 1)
+        ++count;
+    return count;
+}
+
+// Index of the lowest set bit of a nonzero lane mask, from a de Bruijn sequence.
+static inline uint32_t lowestBit(const uint32_t bits)
+{
+    constexpr uint8_t INDICES[32] { 0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8, 31,
+        27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9 };
+    return INDICES[((bits & (0u - bits)) * 0x077CB531u) >> 27];
+}
+
+template <typename Lanes> struct Query {
+    typename Lanes::Float _x;
+    typename Lanes::Float _y;
+    typename Lanes::Float _z;
+};
+
+template <typename Lanes> Query<Lanes> broadcastPosition(const NeighborQuery& query)
+{
+    return { Lanes::broadcast(query._position[0]), Lanes::broadcast(query._position[1]),
+        Lanes::broadcast(query._position[2]) };
+}
+
+template <typename Lanes>
+void densityLanes(const KernelConstants& constants, const NeighborArrays& arrays,
+    const uint32_t j, const uint32_t count, const Query<Lanes>& position, float& density,
+    float& nearDensity)
+{
+    using Float = typename Lanes::Float;
+    const bool full = count >= Lanes::WIDTH;
+    auto load = [full, j, count](const float* values) {
+        return full ? Lanes::load(values + j) : Lanes::loadPartial(values + j, count);
+    };
+    const Float dx = Lanes::sub(load(arrays._x), position._x);
+    const Float dy = Lanes::sub(load(arrays._y), position._y);
+    const Float dz = Lanes::sub(load(arrays._z), position._z);
+    const Float squareDistance = Lanes::add(
+        Lanes::add(Lanes::mul(dx, dx), Lanes::mul(dy, dy)), Lanes::mul(dz, dz));
+
+    // Same tests as the scalar loop and SpikyKernel::value. Lanes past the range hold the origin,
+    // so they are masked out as well.
+    const Float radius = Lanes::broadcast(constants._radius);
+    const Float distance = Lanes::sqrt(squareDistance);
+    auto inside = Lanes::both(
+        Lanes::lessEqual(squareDistance, Lanes::broadcast(constants._squareRadius)),
+        Lanes::less(distance, radius));
+    if (!full)
+        inside = Lanes::both(inside, Lanes::firstLanes(count));
+    uint32_t bits = Lanes::bits(inside);
+    if (!bits)
+        return;
+
+    const Float v = Lanes::sub(radius, distance);
+    const Float squareV = Lanes::mul(v, v);
+    float terms[Lanes::WIDTH];
+    float nearTerms[Lanes::WIDTH];
+    Lanes::store(terms, Lanes::mul(squareV, Lanes::broadcast(constants._spikyPow2)));
+    Lanes::store(
+        nearTerms, Lanes::mul(Lanes::mul(squareV, v), Lanes::broadcast(constants._spikyPow3)));
+
+    // One neighbor at a time, in order, so the sums round as the scalar loop's do. The scalar loop
+    // adds zero for the lanes left out, which changes nothing.
+    for (; bits; bits &= bits - 1) {
+        const uint32_t lane = lowestBit(bits);
+        density += terms[lane];
+        nearDensity += nearTerms[lane];
+    }
+}
+
+template <typename Lanes>
+void densities(const KernelConstants& constants, const NeighborArrays& arrays,
+    const uint32_t first, const uint32_t last, NeighborQuery& query)
+{
+    const Query<Lanes> position = broadcastPosition<Lanes>(query);
+    float density = query._density;
+    float nearDensity = query._nearDensity;
+    for (uint32_t j = first; j < last; j += Lanes::WIDTH)
+        densityLanes<Lanes>(constants, arrays, j, last - j, position, density, nearDensity);
+    query._density = density;
+    query._nearDensity = nearDensity;
+}
+
+template <typename Lanes>
+void pressureLanes(const KernelConstants& constants, const NeighborArrays& arrays,
+    const uint32_t j, const uint32_t count, const Query<Lanes>& position, NeighborQuery& query)
+{
+    using Float = typename Lanes::Float;
+    const bool full = count >= Lanes::WIDTH;
+    auto load = [full, j, count](const float* values) {
+        return full ? Lanes::load(values + j) : Lanes::loadPartial(values + j, count);
+    };
+    const Float dx = Lanes::sub(load(arrays._x), position._x);
+    const Float dy = Lanes::sub(load(arrays._y), position._y);
+    const Float dz = Lanes::sub(load(arrays._z), position._z);
+    const Float squareDistance = Lanes::add(
+        Lanes::add(Lanes::mul(dx, dx), Lanes::mul(dy, dy)), Lanes::mul(dz, dz));
+
+    auto inside = Lanes::lessEqual(squareDistance, Lanes::broadcast(constants._squareRadius));
+    if (!full)
+        inside = Lanes::both(inside, Lanes::firstLanes(count));
+    query._neighborCount += countBits(Lanes::bits(inside));
+
+    // Coincident particles push in no direction, so only lanes apart from the particle add force.
+    const Float distance = Lanes::sqrt(squareDistance);
+    uint32_t bits
+        = Lanes::bits(Lanes::both(inside, Lanes::greater(distance, Lanes::broadcast(1e-6f))));
+    if (!bits)
+        return;
+
+    // Same terms, in the same order, as SPH::calculatePressureForce, including its near pressure
+    // taken from the neighbor's density. Lanes left out may divide by zero, but are never added.
+    const Float density = load(arrays._density);
+    const Float nearDensity = load(arrays._nearDensity);
+    const Float half = Lanes::broadcast(0.5f);
+    const Float pressure
+        = Lanes::mul(Lanes::sub(density, Lanes::broadcast(constants._targetDensity)),
+            Lanes::broadcast(constants._pressureMultiplier));
+    const Float nearPressure
+        = Lanes::mul(density, Lanes::broadcast(constants._nearPressureMultiplier));
+    const Float sharedPressure
+        = Lanes::mul(Lanes::add(Lanes::broadcast(query._pressure), pressure), half);
+    const Float sharedNearPressure
+        = Lanes::mul(Lanes::add(Lanes::broadcast(query._nearPressure), nearPressure), half);
+    const Float clampedNearDensity = Lanes::max(nearDensity, Lanes::broadcast(1e-6f));
+
+    // Derivatives are negative, and zero where the root lands past the radius.
+    const Float radius = Lanes::broadcast(constants._radius);
+    const Float negativeV = Lanes::sub(distance, radius);
+    const auto onKernel = Lanes::lessEqual(distance, radius);
+    const Float slope = Lanes::select(
+        onKernel, Lanes::mul(negativeV, Lanes::broadcast(constants._spikyPow2Grad)));
+    const Float nearSlope = Lanes::select(onKernel,
+        Lanes::mul(Lanes::mul(negativeV, Lanes::sub(radius, distance)),
+            Lanes::broadcast(constants._spikyPow3Grad)));
+
+    float terms[6][Lanes::WIDTH];
+    const Float delta[3] { dx, dy, dz };
+    for (int axis = 0; axis < 3; ++axis) {
+        const Float direction = Lanes::div(delta[axis], distance);
+        Lanes::store(terms[2 * axis],
+            Lanes::div(Lanes::mul(Lanes::mul(direction, slope), sharedPressure), density));
+        Lanes::store(terms[2 * axis + 1],
+            Lanes::div(Lanes::mul(Lanes::mul(direction, nearSlope), sharedNearPressure),
+                clampedNearDensity));
+    }
+    // Interleaved per neighbor, like the scalar loop's two += on the same vector.
+    for (; bits; bits &= bits - 1) {
+        const uint32_t lane = lowestBit(bits);
+        for (int axis = 0; axis < 3; ++axis) {
+            query._force[axis] += terms[2 * axis][lane];
+            query._force[axis] += terms[2 * axis + 1][lane];
+        }
+    }
+}
+
+template <typename Lanes>
+void pressureForce(const KernelConstants& constants, const NeighborArrays& arrays,
+    const uint32_t first, const uint32_t last, NeighborQuery& query)
+{
+    const Query<Lanes> position = broadcastPosition<Lanes>(query);
+    for (uint32_t j = first; j < last; j += Lanes::WIDTH)
+        pressureLanes<Lanes>(constants, arrays, j, last - j, position, query);
+}
+
+template <typename Lanes> constexpr NeighborKernels kernels()
+{
+    return { &densities<Lanes>, &pressureForce<Lanes> };
+}
+} // namespace neighbor_kernels
+
+#endif // NEIGHBORKERNELSIMPL_H
@@ -0,0 +1,52 @@
+#include "NeighborKernelsImpl.h"
+#include <smmintrin.h>
+
+// Compiled with SSE4.1 enabled; only called after detectSimdLevel found it.
+
+namespace {
+struct Sse4Lanes {
+    using Float = __m128;
+    using Mask = __m128;
+    static constexpr uint32_t WIDTH = 4;
+
+    static Float broadcast(const float value) { return _mm_set1_ps(value); }
+    static Float load(const float* values) { return _mm_loadu_ps(values); }
+
+    // SSE has no masked load, so copy the lanes that exist to stay inside the array.
+    static Float loadPartial(const float* values, const uint32_t count)
+    {
+        alignas(16) float lanes[WIDTH] {};
+        for (uint32_t lane = 0; lane < count; ++lane)
+            lanes[lane] = values[lane];
+        return _mm_load_ps(lanes);
+    }
+
+    static Mask firstLanes(const uint32_t count)
+    {
+        return _mm_castsi128_ps(_mm_cmplt_epi32(
+            _mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int>(count))));
+    }
+
+    static Float add(const Float a, const Float b) { return _mm_add_ps(a, b); }
+    static Float sub(const Float a, const Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(const Float a, const Float b) { return _mm_mul_ps(a, b); }
+    static Float div(const Float a, const Float b) { return _mm_div_ps(a, b); }
+    static Float max(const Float a, const Float b) { return _mm_max_ps(a, b); }
+    static Float sqrt(const Float a) { return _mm_sqrt_ps(a); }
+    static Mask less(const Float a, const Float b) { return _mm_cmplt_ps(a, b); }
+    static Mask lessEqual(const Float a, const Float b) { return _mm_cmple_ps(a, b); }
+    static Mask greater(const Float a, const Float b) { return _mm_cmpgt_ps(a, b); }
+    static Mask both(const Mask a, const Mask b) { return _mm_and_ps(a, b); }
+    static Float select(const Mask mask, const Float value) { return _mm_and_ps(mask, value); }
+
+    static void store(float* values, const Float a) { _mm_storeu_ps(values, a); }
+
+    static uint32_t bits(const Mask mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask)); }
+};
+} // namespace
+
+const NeighborKernels& sse4NeighborKernels()
+{
+    static constexpr NeighborKernels kernels = neighbor_kernels::kernels<Sse4Lanes>();
+    return kernels;
+}
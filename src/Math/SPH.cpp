@@ -1,14 +1,71 @@
 #include "Math/SPH.h"
 #include <algorithm>
+#include <array>
 #include <barrier>
+#include <bit>
+#include <chrono>
 #include <cmath>
 #include <numeric>
-#include <objc/objc.h>
 #include <ranges>
+#include <span>
+#include <string>
 #include <thread>
 #include <utility>
 
+#include "AllocationAudit.h"
+#include "Math/SpaceFillingCurves.h"
 #include "Rules.h"
+#include "Tracer.h"
+
+// Radix sort digit width used by the parallel spatial hash build.
+static constexpr uint32_t MAX_RADIX_BITS = 11;
+static constexpr uint32_t MAX_RADIX = 1u << MAX_RADIX_BITS;
+
+// Particles per block handed out by the work-stealing schedulers.
+static constexpr size_t SCHEDULER_BLOCK_SIZE = 128;
+
+// Kernel policies of the near density and viscosity terms, whichever density kernel is picked.
+template <typename Kernel> using NearKernel = SpikyPow3Kernel<Kernel::DIMENSIONS>;
+template <typename Kernel> using ViscosityKernel = Poly6Kernel<Kernel::DIMENSIONS>;
+
+// Largest cell table the dense grid will allocate before falling back to hashing.
+static constexpr size_t MAX_DENSE_CELLS = size_t { 1 } << 24;
+
+// Bits per axis of the space-filling curve used to order hashed (unbounded) cells. mortonIndex
+// handles at most 10 in 3D.
+static constexpr uint32_t HASHED_CURVE_BITS = 10;
+
+// Distances at which the density kernel's slope is sampled for its maximum.
+static constexpr int KERNEL_SLOPE_SAMPLES = 64;
+
+const char* phaseName(const SPHPhase phase)
+{
+    switch (phase) {
+    case SPHPhase::ExternalForces:
+        return "applyExternalForces";
+    case SPHPhase::SpatialHash:
+        return "buildSpatialHash";
+    case SPHPhase::Offsets:
+        return "buildOffsets";
+    case SPHPhase::Reorder:
+        return "reorderParticles";
+    case SPHPhase::NeighborLists:
+        return "buildNeighborLists";
+    case SPHPhase::Densities:
+        return "calculateDensities";
+    case SPHPhase::PressureSolve:
+        return "solvePressure";
+    case SPHPhase::PressureForce:
+        return "calculatePressureForce";
+    case SPHPhase::Viscosity:
+        return "calculateViscosity";
+    case SPHPhase::UpdatePositions:
+        return "updatePositions";
+    case SPHPhase::Step:
+        break;
+    }
+    return "step";
+}
 
 SPH& SPH::getInstance()
 {
@@ -16,43 +73,101 @@ SPH& SPH::getInstance()
     return instance;
 }
 
-void SPH::init(SPHConfig config, const std::vector<Particle>& particles)
+void SPH::init(SPHConfig config, const std::vector<Particle>& particles, const size_t threads)
 {
+    stopWorkers();
     _config = std::move(config);
-    _particles = particles;
+    _dimensions = _config.dimensions == 2 ? 2 : 3;
+
+    const size_t n = particles.size();
+    _particles.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        _particles._position.set(i, particles[i]._position);
+        _particles._predicted.set(i, particles[i]._predicted);
+        _particles._velocity.set(i, particles[i]._velocity);
+    }
+
+    // Nothing moves 2D particles off the plane after this: every force between them lies in it.
+    if (_dimensions == 2) {
+        for (Vec3Field* field :
+            { &_particles._position, &_particles._predicted, &_particles._velocity })
+            std::ranges::fill(field->_z, 0.0f);
+    }
+    std::ranges::fill(_particles._pressure, 0.0f);
 
-    const size_t n = _particles.size();
     _keys.resize(n);
+    _sortedKeys.resize(n);
     _sortedIndices.resize(n);
-    _offsets.resize(n);
+    _indexScratch.resize(n);
     _reorderBuffer.resize(n);
     _velocitySnapshot.resize(n);
-
-    const uint32_t threadCount = std::min<uint32_t>(
-        std::max(1u, std::thread::hardware_concurrency()), static_cast<uint32_t>(n));
+    _selfDisplacement.resize(n);
+    _neighborDisplacement.resize(n);
+    _pressureDiagonal.resize(n);
+    _advectedDensity.resize(n);
+    for (AlignedVector<float>& pressures : _solverPressure)
+        pressures.resize(n);
+    for (Vec3Field& positions : _projected)
+        positions.resize(n);
+    _lambda.resize(n);
+    _neighborOffsets.resize(n + 1);
+    _listPositions.resize(n);
+    _listCellSize = 0.0f;
+    _neighborsCellSize = 0.0f;
+    _listsOverflowed = false;
+    _curveKeysDims = { 0, 0, 0 }; // 2D and 3D curves differ, so rebuild the table
+
+    const size_t requested = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    const size_t threadCount = std::clamp<size_t>(requested, 1, std::max<size_t>(n, 1));
+    _threadCount = threadCount;
     _threads.resize(threadCount - 1);
     _chunk = (_particles.size() + threadCount - 1) / threadCount;
     _barrier = std::make_unique<std::barrier<>>(threadCount);
 
+    _histograms.resize(static_cast<size_t>(MAX_RADIX) * threadCount);
+    _blockSums.resize(threadCount);
+    _maxDisplacement.resize(threadCount);
+    _maxSpeed.assign(threadCount, 0.0f);
+    _maxAcceleration.assign(threadCount, 0.0f);
+    _densityErrors.assign(threadCount, 0.0f);
+    for (size_t i = 0; i < n; ++i) {
+        const Vec3<float> velocity = particles[i]._velocity;
+        _maxSpeed[0] = std::max(_maxSpeed[0], velocity * velocity);
+    }
+    _pairAccumulators.assign(threadCount, {});
+    _idleTime.assign(threadCount, 0.0f);
+    _phaseTimes.assign(threadCount, {});
+    _profiles = std::vector<ThreadProfile>(threadCount);
+    for (BlockScheduler* scheduler : { &_densityBlocks, &_pressureBlocks, &_viscosityBlocks,
+             &_displacementBlocks, &_relaxBlocks })
+        scheduler->init(threadCount);
+
     for (size_t thread = 0; thread < _threads.size(); ++thread) {
         _threads[thread] = std::thread(&SPH::threadLoop, this, thread + 1);
     }
-
-    const float smoothingRadius = _config.smoothingRadius;
-    K_SpikyPow2 = 15.0f / (2.0f * PI * std::pow(smoothingRadius, 5));
-    K_SpikyPow3 = 15.0f / (PI * std::pow(smoothingRadius, 6));
-    K_SpikyPow2Grad = 15.0f / (PI * std::pow(smoothingRadius, 5));
-    K_SpikyPow3Grad = 45.0f / (PI * std::pow(smoothingRadius, 6));
 }
 
 SPH::~SPH()
 {
-    if (!_threads.empty()) {
-        _running = false;
-        _barrier->arrive_and_wait();
-        for (auto& thread : _threads)
-            thread.join();
-    }
+    stopWorkers();
+}
+
+void SPH::stopWorkers()
+{
+    if (_threads.empty())
+        return;
+
+    _running = false;
+    _barrier->arrive_and_wait();
+    for (auto& thread : _threads)
+        thread.join();
+    _threads.clear();
+    _running = true;
+}
+
+size_t SPH::threadCount() const
+{
+    return _threadCount;
 }
 
 // Offsets for the 3x3x3 neighborhood around a cell (including the cell itself).
@@ -62,6 +177,9 @@ const Vec3<int> SPH::OFFSETS_3D[27] = { { -1, -1, -1 }, { 0, -1, -1 }, { 1, -1,
     { 1, 1, 0 }, { -1, -1, 1 }, { 0, -1, 1 }, { 1, -1, 1 }, { -1, 0, 1 }, { 0, 0, 1 }, { 1, 0, 1 },
     { -1, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 } };
 
+const Vec3<int> SPH::OFFSETS_2D[9] = { { -1, -1, 0 }, { 0, -1, 0 }, { 1, -1, 0 }, { -1, 0, 0 },
+    { 0, 0, 0 }, { 1, 0, 0 }, { -1, 1, 0 }, { 0, 1, 0 }, { 1, 1, 0 } };
+
 // Fast integer hash constants for cell coordinates.
 static constexpr int HASH_X = 73856093;
 static constexpr int HASH_Y = 19349663;
@@ -77,50 +195,49 @@ const SPHConfig& SPH::config() const
     return _config;
 }
 
-float SPH::densityKernel(const float distance) const
+void SPH::setInstanceSink(const InstanceSink& sink)
 {
-    if (const float h = _config.smoothingRadius; distance < h) {
-        const float v = h - distance;
-        return v * v * K_SpikyPow2;
-    }
-    return 0;
+    _instanceSink = sink;
 }
 
-float SPH::nearDensityKernel(const float distance) const
+const std::vector<PhaseTimes>& SPH::phaseTimes() const
 {
-    if (const float h = _config.smoothingRadius; distance < h) {
-        const float v = h - distance;
-        return v * v * v * K_SpikyPow3;
-    }
-    return 0;
+    return _phaseTimes;
 }
 
-float SPH::densityDerivative(const float distance) const
+int SPH::pressureIterations() const
 {
-    if (const float h = _config.smoothingRadius; distance <= h) {
-        const float v = h - distance;
-        return -v * K_SpikyPow2Grad;
-    }
-    return 0;
+    return _pressureIterations;
 }
 
-float SPH::nearDensityDerivative(const float distance) const
+float SPH::densityError() const
 {
-    if (const float h = _config.smoothingRadius; distance <= h) {
-        const float v = h - distance;
-        return -v * v * K_SpikyPow3Grad;
-    }
-    return 0;
+    return _densityError;
 }
 
-float SPH::poly6Kernel(const float distance) const
+SimdLevel SPH::simdLevel() const
 {
-    if (const float h = _config.smoothingRadius; distance < h) {
-        const float scale = 315.0f / (64.0f * PI * std::pow(h, 9));
-        const float v = h * h - distance * distance;
-        return v * v * v * scale;
-    }
-    return 0;
+    return _simdLevel;
+}
+
+int SPH::substepCount() const
+{
+    return _substepCount;
+}
+
+float SPH::timestep() const
+{
+    return _dt;
+}
+
+const std::vector<float>& SPH::idleTimes() const
+{
+    return _idleTime;
+}
+
+float SPH::stepTime() const
+{
+    return _stepTime;
 }
 
 float SPH::pressureFromDensity(const float density) const
@@ -133,9 +250,9 @@ float SPH::nearPressureFromDensity(const float nearDensity) const
     return nearDensity * _config.nearPressureMultiplier;
 }
 
-Vec3<int> SPH::getCell(const Particle& particle) const
+Vec3<int> SPH::getCell(const size_t index) const
 {
-    return Vec3<int>(particle._predicted / _config.smoothingRadius);
+    return Vec3<int>(_particles._predicted.get(index) / _cellSize);
 }
 
 int SPH::hash(const Vec3<int>& cell)
@@ -148,249 +265,1721 @@ uint32_t SPH::keyFromHash(const uint32_t hash) const
     return hash % _particles.size();
 }
 
-void SPH::resolveCollisions(Particle& particle) const
+Vec3<int> SPH::getGridCell(const size_t index) const
+{
+    const Vec3<float> local
+        = (_particles._predicted.get(index) + _config.bounds) / _cellSize;
+    Vec3<int> cell;
+    for (size_t axis = 0; axis < 3; ++axis) {
+        // Clamp before converting so particles predicted outside the box land in the edge cells.
+        // NaN fails every comparison, so it is tested first and lands in cell 0; std::clamp would
+        // pass it through to an out-of-range index.
+        const float coordinate = local[axis];
+        cell[axis] = !(coordinate >= 0.0f)
+            ? 0
+            : static_cast<int>(std::min(coordinate, static_cast<float>(_gridDims[axis] - 1)));
+    }
+    return cell;
+}
+
+uint32_t SPH::cellKey(const size_t index) const
+{
+    return keyFromCell(_denseGrid ? getGridCell(index) : getCell(index));
+}
+
+uint32_t SPH::keyFromCell(const Vec3<int>& cell) const
+{
+    if (_denseGrid) {
+        const int rowMajor = (cell[2] * _gridDims[1] + cell[1]) * _gridDims[0] + cell[0];
+        return _particleOrder == ParticleOrder::CellKey ? static_cast<uint32_t>(rowMajor)
+                                                        : _curveKeys[rowMajor];
+    }
+
+    // Hashed cells are unbounded, so curve indices wrap every 2^HASHED_CURVE_BITS cells. Taking
+    // the curve index modulo the table size keeps nearby cells on nearby keys.
+    const Vec3<int> wrapped = cell + (1 << (HASHED_CURVE_BITS - 1));
+    switch (_particleOrder) {
+    case ParticleOrder::Morton:
+        return keyFromHash(mortonIndex(wrapped, HASHED_CURVE_BITS, _dimensions));
+    case ParticleOrder::Hilbert:
+        return keyFromHash(hilbertIndex(wrapped, HASHED_CURVE_BITS, _dimensions));
+    case ParticleOrder::CellKey:
+    default:
+        return keyFromHash(hash(cell));
+    }
+}
+
+void SPH::updateGridLayout()
+{
+    _denseGrid = false;
+    _keyCount = _particles.size();
+    _particleOrder = _config.particleOrder;
+
+    // Neighbor lists search out to smoothingRadius + skin, so cells grow to keep that within the
+    // 3x3x3 stencil, or the 3x3 one in 2D.
+    _cellSize = _config.smoothingRadius + (_useNeighborLists ? _config.neighborSkin : 0.0f);
+
+    if (_config.neighborGrid == NeighborGrid::Dense) {
+        int maxDim = 1;
+        size_t cellCount = 1;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            // A 2D grid is a single layer of cells, which the plane of particles clamps into.
+            _gridDims[axis] = axis >= static_cast<size_t>(_dimensions)
+                ? 1
+                : std::max(1, static_cast<int>(std::ceil(2.0f * _config.bounds[axis] / _cellSize)));
+            maxDim = std::max(maxDim, _gridDims[axis]);
+            cellCount *= static_cast<size_t>(_gridDims[axis]);
+        }
+
+        // Curve indices address the power-of-two cube around the grid, or the square in 2D.
+        if (_particleOrder != ParticleOrder::CellKey) {
+            _curveBits = std::max<uint32_t>(
+                1, static_cast<uint32_t>(std::bit_width(static_cast<uint32_t>(maxDim - 1))));
+            cellCount = size_t { 1 } << (static_cast<uint32_t>(_dimensions) * _curveBits);
+        }
+
+        // Fall back to hashing when the box is too large for a dense table.
+        if (cellCount <= MAX_DENSE_CELLS) {
+            _denseGrid = true;
+            _keyCount = cellCount;
+        }
+    }
+
+    // Curve keys of the dense cells only change with the grid, so look them up from a table.
+    if (_denseGrid && _particleOrder != ParticleOrder::CellKey) {
+        if (const auto diff = _gridDims - _curveKeysDims;
+            diff * diff != 0 || _curveKeysOrder != _particleOrder) {
+            _curveKeysDims = _gridDims;
+            _curveKeysOrder = _particleOrder;
+            _curveKeys.resize(static_cast<size_t>(_gridDims[0]) * _gridDims[1] * _gridDims[2]);
+            size_t rowMajor = 0;
+            for (int z = 0; z < _gridDims[2]; ++z) {
+                for (int y = 0; y < _gridDims[1]; ++y) {
+                    for (int x = 0; x < _gridDims[0]; ++x) {
+                        _curveKeys[rowMajor++] = _particleOrder == ParticleOrder::Morton
+                            ? mortonIndex({ x, y, z }, _curveBits, _dimensions)
+                            : hilbertIndex({ x, y, z }, _curveBits, _dimensions);
+                    }
+                }
+            }
+        }
+    }
+
+    _offsets.resize(_keyCount + 1);
+}
+
+template <int Dimensions, typename Visitor>
+void SPH::forEachNeighborRange(const size_t index, Visitor&& visit) const
+{
+    if (!_denseGrid) {
+        const auto originCell = getCell(index);
+        std::span<const Vec3<int>> stencil = OFFSETS_3D;
+        if constexpr (Dimensions == 2)
+            stencil = OFFSETS_2D;
+        for (const auto& offset : stencil) {
+            const uint32_t key = keyFromCell(originCell + offset);
+            visit(_offsets[key], _offsets[key + 1]);
+        }
+        return;
+    }
+
+    const Vec3<int> cell = getGridCell(index);
+    const int firstX = std::max(cell[0] - 1, 0);
+    const int lastX = std::min(cell[0] + 1, _gridDims[0] - 1);
+    const int firstZ = Dimensions == 2 ? cell[2] : std::max(cell[2] - 1, 0);
+    const int lastZ = Dimensions == 2 ? cell[2] : std::min(cell[2] + 1, _gridDims[2] - 1);
+    for (int z = firstZ; z <= lastZ; ++z) {
+        for (int y = std::max(cell[1] - 1, 0); y <= std::min(cell[1] + 1, _gridDims[1] - 1); ++y) {
+            if (_particleOrder == ParticleOrder::CellKey) {
+                // Neighboring cells along x are adjacent keys, so each (y, z) row of the 3x3x3
+                // stencil is one contiguous range of particles.
+                const int row = (z * _gridDims[1] + y) * _gridDims[0];
+                visit(_offsets[row + firstX], _offsets[row + lastX + 1]);
+                continue;
+            }
+
+            for (int x = firstX; x <= lastX; ++x) {
+                const uint32_t key = keyFromCell({ x, y, z });
+                visit(_offsets[key], _offsets[key + 1]);
+            }
+        }
+    }
+}
+
+template <int Dimensions, typename Visitor>
+void SPH::forEachNeighbor(const size_t index, Visitor&& visit) const
+{
+    if (_useNeighborLists && !_listsOverflowed) {
+        for (uint32_t k = _neighborOffsets[index]; k < _neighborOffsets[index + 1]; ++k)
+            visit(_neighbors[k]);
+        return;
+    }
+
+    forEachNeighborRange<Dimensions>(index, [&visit](const uint32_t first, const uint32_t last) {
+        for (uint32_t j = first; j < last; ++j)
+            visit(j);
+    });
+}
+
+template <int Dimensions, typename Visitor>
+void SPH::forEachNeighborPair(const size_t index, Visitor&& visit) const
+{
+    if (_useNeighborLists || !_denseGrid || _particleOrder != ParticleOrder::CellKey) {
+        forEachNeighbor<Dimensions>(index, [&visit, index](const uint32_t j) {
+            if (j > index)
+                visit(j);
+        });
+        return;
+    }
+
+    // Rows before the particle's own row only hold smaller keys, and so smaller indices. In its
+    // own row everything after the particle itself comes later in the sort.
+    const Vec3<int> cell = getGridCell(index);
+    const int firstX = std::max(cell[0] - 1, 0);
+    const int lastX = std::min(cell[0] + 1, _gridDims[0] - 1);
+    const int lastZ = Dimensions == 2 ? cell[2] : std::min(cell[2] + 1, _gridDims[2] - 1);
+    for (int z = cell[2]; z <= lastZ; ++z) {
+        const int firstY = z == cell[2] ? cell[1] : std::max(cell[1] - 1, 0);
+        for (int y = firstY; y <= std::min(cell[1] + 1, _gridDims[1] - 1); ++y) {
+            const int row = (z * _gridDims[1] + y) * _gridDims[0];
+            const uint32_t first = z == cell[2] && y == cell[1] ? static_cast<uint32_t>(index) + 1
+                                                                : _offsets[row + firstX];
+            for (uint32_t j = first; j < _offsets[row + lastX + 1]; ++j)
+                visit(j);
+        }
+    }
+}
+
+void SPH::resolveCollisions(const size_t index)
 {
     auto sign = [](const float v) { return v >= 0 ? 1.0f : -1.0f; };
-    for (auto&& [position, velocity, halfBound] :
-        std::views::zip(particle._position, particle._velocity, _config.bounds)) {
-        if (halfBound - std::abs(position) <= 0) {
-            position = halfBound * sign(position);
-            velocity *= -_config.collisionDamping;
+    Vec3Field& position = _particles._position;
+    Vec3Field& velocity = _particles._velocity;
+    float* positions[3] = { &position._x[index], &position._y[index], &position._z[index] };
+    float* velocities[3] = { &velocity._x[index], &velocity._y[index], &velocity._z[index] };
+    for (size_t axis = 0; axis < 3; ++axis) {
+        if (const float halfBound = _config.bounds[axis];
+            halfBound - std::abs(*positions[axis]) <= 0) {
+            *positions[axis] = halfBound * sign(*positions[axis]);
+            *velocities[axis] *= -_config.collisionDamping;
         }
     }
 }
 
 void SPH::step()
 {
+    const AllocationScope allocationScope;
+    const auto stepStart = std::chrono::steady_clock::now();
     _useViscosity = _config.viscosityStrength != 0.0f;
+    _useNeighborLists = _config.neighborLists;
+    _symmetricPairs = _config.symmetricPairs;
+    _implicitPressure = _config.pressureSolver == PressureSolver::Implicit;
+    _positionBased = _config.pressureSolver == PressureSolver::PositionBased;
+    _fusedForces = _config.fusedForces && _useViscosity && !_symmetricPairs
+        && _config.pressureSolver == PressureSolver::StateEquation;
+
+    // Only the first step with pairs on allocates the sums; resizing to the same count is free.
+    if (_symmetricPairs) {
+        for (PairAccumulator& accumulator : _pairAccumulators)
+            accumulator.resize(_particles.size());
+    }
+
+    const float radius = _config.smoothingRadius;
+    _smoothingKernel = _config.smoothingKernel;
+    withSmoothingKernel(_smoothingKernel, _dimensions, [this, radius](auto kernel) {
+        using Kernel = decltype(kernel);
+        _densityKernel = Kernel::coefficients(radius);
+        _nearKernel = NearKernel<Kernel>::coefficients(radius);
+        _viscosityKernel = ViscosityKernel<Kernel>::coefficients(radius);
+
+        // Steepest slope of the density kernel over its support, sampled since it lies at the
+        // center for some shapes and inside the support for others.
+        _densitySlope = 0.0f;
+        for (int sample = 0; sample <= KERNEL_SLOPE_SAMPLES; ++sample) {
+            const float distance = radius * static_cast<float>(sample) / KERNEL_SLOPE_SAMPLES;
+            _densitySlope
+                = std::max(_densitySlope, std::abs(Kernel::derivative(_densityKernel, distance)));
+        }
+    });
+
+    // The vector kernels walk contiguous ranges of the grid, which neighbor lists do not have, and
+    // only evaluate the spiky shape.
+    _simdLevel = _useNeighborLists || _smoothingKernel != SmoothingKernel::Spiky
+        ? SimdLevel::Scalar
+        : std::min(_config.simdLevel, detectSimdLevel());
+    _kernels = neighborKernels(_simdLevel);
+    _kernelConstants = { radius, radius * radius, _densityKernel._value, _nearKernel._value,
+        _densityKernel._gradient, _nearKernel._gradient, _config.targetDensity,
+        _config.pressureMultiplier, _config.nearPressureMultiplier };
+    _pressureIterations = 0;
+    _densityError = 0.0f;
+    resetProfiles();
+
+    // Split what is left of the frame into equal substeps no longer than the stable step, so a
+    // frame never ends on a sliver of a substep.
+    float remaining = _config.frameTime;
+    _substepCount = 0;
+    while (remaining > 0.0f) {
+        const float stable = _config.adaptiveTimestep ? stableTimestep() : remaining;
+        const auto substepsLeft
+            = static_cast<float>(std::max(_config.maxSubsteps - _substepCount, 1));
+        const float substeps = std::clamp(std::ceil(remaining / stable), 1.0f, substepsLeft);
+        _dt = remaining / substeps;
+        remaining = substeps > 1.0f ? remaining - _dt : 0.0f;
+        _finalSubstep = remaining == 0.0f;
+        substep();
+        ++_substepCount;
+    }
+
+    publishProfiles();
+    const auto stepEnd = std::chrono::steady_clock::now();
+    _stepTime = std::chrono::duration<float, std::milli>(stepEnd - stepStart).count();
+}
+
+void SPH::substep()
+{
+    updateGridLayout();
+
+    // Lists built for another cell size (or none at all) cannot be reused.
+    _forceListRebuild = !_useNeighborLists || _listCellSize != _cellSize;
+
+    // Schedulers can only be refilled while no worker is taking blocks.
+    const size_t count = _particles.size();
+    for (BlockScheduler* scheduler : { &_densityBlocks, &_pressureBlocks, &_viscosityBlocks,
+             &_displacementBlocks, &_relaxBlocks })
+        scheduler->reset(count, SCHEDULER_BLOCK_SIZE);
+
     threadStep(0);
+    // Lists that did not fit are retried on the next substep.
+    _listCellSize = _useNeighborLists && !_listsOverflowed ? _cellSize : 0.0f;
 }
 
-void SPH::threadLoop(const size_t thread)
+float SPH::stableTimestep() const
 {
-    while (true) {
-        threadStep(thread);
-        if (!_running)
+    // Gravity is not part of the reduced acceleration, so add it to the bound.
+    const float radius = _config.smoothingRadius;
+    const float maxSpeed = std::sqrt(*std::ranges::max_element(_maxSpeed));
+    const float maxAcceleration
+        = std::sqrt(*std::ranges::max_element(_maxAcceleration)) + std::abs(_config.gravity);
+
+    float dt = _config.frameTime;
+    if (maxSpeed > 0.0f)
+        dt = std::min(dt, _config.courantNumber * radius / maxSpeed);
+    if (maxAcceleration > 0.0f)
+        dt = std::min(dt, _config.forceNumber * std::sqrt(radius / maxAcceleration));
+    return std::max(dt, _config.frameTime / static_cast<float>(std::max(_config.maxSubsteps, 1)));
+}
+
+void SPH::runPhase(const SPHPhase phase)
+{
+    if (phase == SPHPhase::Step) {
+        step();
+        return;
+    }
+
+    const size_t count = _particles.size();
+    for (BlockScheduler* scheduler : { &_densityBlocks, &_pressureBlocks, &_viscosityBlocks,
+             &_displacementBlocks, &_relaxBlocks })
+        scheduler->reset(count, SCHEDULER_BLOCK_SIZE);
+    resetProfiles();
+
+    // Workers only read _phase after the start barrier, and are back waiting at it once
+    // threadStep returns, so it can be changed freely here.
+    _phase = phase;
+    threadStep(0);
+    _phase = SPHPhase::Step;
+    publishProfiles();
+}
+
+template <typename Kernel> void SPH::threadPhase(const size_t thread, const SPHPhase phase)
+{
+    const size_t start = std::min(thread * _chunk, _particles.size());
+    const size_t end = std::min(start + _chunk, _particles.size());
+    size_t first = 0;
+    size_t last = 0;
+
+    switch (phase) {
+    case SPHPhase::Step:
+        break;
+    case SPHPhase::ExternalForces:
+        applyExternalForces(start, end);
+        break;
+    case SPHPhase::SpatialHash:
+        if (_threadCount == 1)
+            buildSpatialHash();
+        else
+            sortSpatialHash(thread);
+        break;
+    case SPHPhase::Offsets:
+        if (_threadCount > 1)
+            buildOffsets(start, end);
+        break;
+    case SPHPhase::Reorder:
+        reorderParticles(start, end);
+        break;
+    case SPHPhase::NeighborLists:
+        if (_useNeighborLists)
+            buildNeighborLists<Kernel::DIMENSIONS>(thread);
+        break;
+    case SPHPhase::Densities:
+        while (_densityBlocks.next(thread, first, last)) {
+            if (_implicitPressure)
+                calculateImplicitDensities<Kernel>(first, last);
+            else if (_positionBased)
+                calculateConstraints<Kernel>(first, last, _particles._predicted);
+            else
+                calculateDensities<Kernel>(first, last);
+        }
+        break;
+    case SPHPhase::PressureSolve:
+        if (_implicitPressure)
+            solvePressure<Kernel>(thread);
+        else if (_positionBased)
+            projectConstraints<Kernel>(thread);
+        break;
+    case SPHPhase::PressureForce:
+        if (_positionBased) {
+            updateProjectedVelocities(start, end, _projected[_finalProjection]);
+        } else if (_implicitPressure) {
+            while (_pressureBlocks.next(thread, first, last))
+                calculateImplicitPressureForce<Kernel>(first, last, _finalPressure);
+        } else if (_symmetricPairs) {
+            calculatePressureForcePairs<Kernel>(thread);
+        } else if (_fusedForces) {
+            while (_pressureBlocks.next(thread, first, last))
+                calculateForces<Kernel>(first, last);
+        } else {
+            while (_pressureBlocks.next(thread, first, last))
+                calculatePressureForce<Kernel>(first, last);
+        }
+        break;
+    case SPHPhase::Viscosity:
+        if (_fusedForces) {
             break;
+        } else if (_symmetricPairs) {
+            calculateViscosityPairs<Kernel>(thread);
+        } else {
+            while (_viscosityBlocks.next(thread, first, last))
+                calculateViscosity<Kernel>(first, last);
+        }
+        break;
+    case SPHPhase::UpdatePositions:
+        updatePositions(start, end);
+        break;
     }
+    waitForWorkers(thread);
+}
+
+void SPH::threadLoop(const size_t thread)
+{
+    // Only decide to stop after the step barrier, otherwise a worker could leave without arriving
+    // at the barrier the destructor waits on.
+    Tracer::setThreadName("SPH worker " + std::to_string(thread));
+    while (threadStep(thread)) { }
 }
 
-void SPH::threadStep(const size_t thread)
+void SPH::waitForWorkers(const size_t thread)
 {
+    ThreadProfile& profile = _profiles[thread];
+    const auto phase = static_cast<size_t>(profile._phase);
+    const auto waitStart = std::chrono::steady_clock::now();
+    sampleCounters(profile, true);
     _barrier->arrive_and_wait();
-    if (!_running)
+    sampleCounters(profile, false);
+    const auto waitEnd = std::chrono::steady_clock::now();
+    Tracer& tracer = Tracer::getInstance();
+    tracer.record(phaseName(profile._phase), "sph", profile._mark, waitStart);
+    tracer.record("waitForWorkers", "sph", waitStart, waitEnd);
+    profile._times._work[phase]
+        += std::chrono::duration<float, std::milli>(waitStart - profile._mark).count();
+    profile._times._wait[phase]
+        += std::chrono::duration<float, std::milli>(waitEnd - waitStart).count();
+    profile._mark = waitEnd;
+}
+
+void SPH::beginPhase(const size_t thread, const SPHPhase phase)
+{
+    ThreadProfile& profile = _profiles[thread];
+    const auto now = std::chrono::steady_clock::now();
+    // Right after a barrier the previous phase has no work left, so skip tracing the sliver.
+    if (now - profile._mark >= std::chrono::microseconds(1))
+        Tracer::getInstance().record(phaseName(profile._phase), "sph", profile._mark, now);
+    profile._times._work[static_cast<size_t>(profile._phase)]
+        += std::chrono::duration<float, std::milli>(now - profile._mark).count();
+    sampleCounters(profile, true);
+    profile._phase = phase;
+    profile._mark = now;
+}
+
+bool SPH::startCounters(ThreadProfile& profile)
+{
+    if (!profile._counters.countsCallingThread()) {
+        if (profile._countersFailed)
+            return false;
+        profile._countersFailed = !profile._counters.open();
+        if (profile._countersFailed)
+            return false;
+    }
+    return profile._counters.read(profile._counterMark);
+}
+
+void SPH::sampleCounters(ThreadProfile& profile, const bool attribute)
+{
+    if (!profile._counting)
         return;
 
-    const auto start = _particles.begin() + thread * _chunk;
-    const auto end = std::min(start + _chunk, _particles.end());
+    CounterValues now;
+    if (!profile._counters.read(now))
+        return;
+    if (attribute)
+        profile._times._counters[static_cast<size_t>(profile._phase)] += now - profile._counterMark;
+    profile._counterMark = now;
+}
+
+void SPH::resetProfiles()
+{
+    for (ThreadProfile& profile : _profiles)
+        profile._times = {};
+}
+
+void SPH::publishProfiles()
+{
+    for (size_t thread = 0; thread < _profiles.size(); ++thread) {
+        const PhaseTimes& times = _profiles[thread]._times;
+        _phaseTimes[thread] = times;
+        _idleTime[thread] = std::accumulate(times._wait.begin(), times._wait.end(), 0.0f);
+    }
+}
+
+bool SPH::threadStep(const size_t thread)
+{
+    _barrier->arrive_and_wait();
+    if (!_running)
+        return false;
+    const AllocationScope allocationScope;
+
+    // The phase timers start here, so time spent between steps is never counted.
+    ThreadProfile& profile = _profiles[thread];
+    profile._phase = _phase == SPHPhase::Step ? SPHPhase::ExternalForces : _phase;
+    profile._counting = _config.hardwareCounters && startCounters(profile);
+    profile._times._counted = profile._counting;
+    profile._mark = std::chrono::steady_clock::now();
+
+    // The kernel shape and dimensions are picked here once, so the neighbor passes below run
+    // without checking them.
+    withSmoothingKernel(_smoothingKernel, _dimensions, [this, thread](auto kernel) {
+        using Kernel = decltype(kernel);
+        if (_phase != SPHPhase::Step)
+            threadPhase<Kernel>(thread, _phase);
+        else
+            threadSubstep<Kernel>(thread);
+    });
+    _barrier->arrive_and_wait();
+    return true;
+}
+
+template <typename Kernel> void SPH::threadSubstep(const size_t thread)
+{
+    const size_t start = std::min(thread * _chunk, _particles.size());
+    const size_t end = std::min(start + _chunk, _particles.size());
 
     // 1) External forces
     applyExternalForces(start, end);
-    _barrier->arrive_and_wait();
+    if (!_forceListRebuild)
+        _maxDisplacement[thread] = maxListDisplacement(start, end);
+    waitForWorkers(thread);
+
+    // Every worker reduces the same values, so all of them agree on whether to rebuild. Lists stay
+    // valid while no particle has moved more than half the skin: no pair can then have closed in
+    // by more than the full skin.
+    const float halfSkin = 0.5f * _config.neighborSkin;
+    const bool rebuild = _forceListRebuild
+        || *std::ranges::max_element(_maxDisplacement) > halfSkin * halfSkin;
+
+    // 2) Spatial hash, cell offsets and reorder, shared by all workers. Skipped while the
+    // neighbor lists are reused, since they refer to the current particle order.
+    if (rebuild) {
+        beginPhase(thread, SPHPhase::SpatialHash);
+        if (_threadCount == 1) {
+            buildSpatialHash();
+        } else {
+            sortSpatialHash(thread);
+            beginPhase(thread, SPHPhase::Offsets);
+            buildOffsets(start, end);
+        }
+        beginPhase(thread, SPHPhase::Reorder);
+        reorderParticles(start, end);
+        waitForWorkers(thread);
 
-    // 2) Spatial hash & reorder must happen once
-    if (thread == 0) {
-        buildSpatialHash();
-        reorderParticles();
+        if (thread == 0) {
+            // Swap buffers instead of copying them back.
+            _particles.swap(_reorderBuffer);
+        }
+        waitForWorkers(thread);
+
+        if (_useNeighborLists) {
+            beginPhase(thread, SPHPhase::NeighborLists);
+            buildNeighborLists<Kernel::DIMENSIONS>(thread);
+        }
+    }
+
+    // 3) Densities. The neighbor passes cost far more per particle in dense regions, so they
+    // take blocks from work-stealing schedulers instead of using the static chunks.
+    size_t first = 0;
+    size_t last = 0;
+    beginPhase(thread, SPHPhase::Densities);
+    float threadError = 0.0f;
+    while (_densityBlocks.next(thread, first, last)) {
+        if (_implicitPressure)
+            calculateImplicitDensities<Kernel>(first, last);
+        else if (_positionBased)
+            threadError += calculateConstraints<Kernel>(first, last, _particles._predicted);
+        else
+            calculateDensities<Kernel>(first, last);
+    }
+    _densityErrors[thread] = threadError;
+    waitForWorkers(thread);
+
+    // 4) Pressure. The largest acceleration and, after integration, the largest speed of each
+    // worker feed the next substep's time step.
+    float maxAcceleration = 0.0f;
+    if (_positionBased) {
+        beginPhase(thread, SPHPhase::PressureSolve);
+        const size_t positions = projectConstraints<Kernel>(thread);
+        beginPhase(thread, SPHPhase::PressureForce);
+        maxAcceleration = updateProjectedVelocities(start, end, _projected[positions]);
+    } else if (_implicitPressure) {
+        beginPhase(thread, SPHPhase::PressureSolve);
+        const size_t pressures = solvePressure<Kernel>(thread);
+        beginPhase(thread, SPHPhase::PressureForce);
+        while (_pressureBlocks.next(thread, first, last)) {
+            maxAcceleration = std::max(
+                maxAcceleration, calculateImplicitPressureForce<Kernel>(first, last, pressures));
+        }
+    } else if (_symmetricPairs) {
+        beginPhase(thread, SPHPhase::PressureForce);
+        maxAcceleration = calculatePressureForcePairs<Kernel>(thread);
+    } else if (_fusedForces) {
+        beginPhase(thread, SPHPhase::PressureForce);
+        while (_pressureBlocks.next(thread, first, last))
+            maxAcceleration = std::max(maxAcceleration, calculateForces<Kernel>(first, last));
+    } else {
+        beginPhase(thread, SPHPhase::PressureForce);
+        while (_pressureBlocks.next(thread, first, last))
+            maxAcceleration
+                = std::max(maxAcceleration, calculatePressureForce<Kernel>(first, last));
+    }
+    _maxAcceleration[thread] = maxAcceleration;
+
+    if (_useViscosity && !_fusedForces) {
+        // The pressure pass already stored its velocities in _velocitySnapshot, so after this
+        // barrier every neighbor's snapshot is complete.
+        waitForWorkers(thread);
+        beginPhase(thread, SPHPhase::Viscosity);
+        if (_symmetricPairs) {
+            calculateViscosityPairs<Kernel>(thread);
+        } else {
+            while (_viscosityBlocks.next(thread, first, last))
+                calculateViscosity<Kernel>(first, last);
+        }
+    }
+
+    waitForWorkers(thread);
+
+    // 5) Final integration. The extra barrier lets every worker record its last wait before the
+    // stepping thread copies the timings.
+    beginPhase(thread, SPHPhase::UpdatePositions);
+    _maxSpeed[thread] = updatePositions(start, end);
+    waitForWorkers(thread);
+}
+
+void SPH::applyExternalForces(const size_t start, const size_t end)
+{
+    const Vec3Field& position = _particles._position;
+    Vec3Field& predicted = _particles._predicted;
+    Vec3Field& velocity = _particles._velocity;
+    const float gravityStep = _config.gravity * _dt;
+    // The implicit solver predicts the density change from the velocities itself, so it finds
+    // neighbors at the current positions.
+    const float predictionStep = _implicitPressure ? 0.0f : _dt;
+
+    for (size_t i = start; i < end; ++i) {
+        velocity._y[i] += gravityStep;
+        predicted._x[i] = position._x[i] + velocity._x[i] * predictionStep;
+        predicted._y[i] = position._y[i] + velocity._y[i] * predictionStep;
+        predicted._z[i] = position._z[i] + velocity._z[i] * predictionStep;
+    }
+}
+
+void SPH::buildSpatialHash()
+{
+    // Counting sort: keys are bounded by _keyCount, so a histogram over the keys followed by a
+    // prefix sum gives every cell's range directly, without a comparison sort.
+    std::ranges::fill(_offsets, 0u);
+    for (size_t i = 0; i < _keys.size(); ++i) {
+        const uint32_t key = cellKey(i);
+        _keys[i] = key;
+        ++_offsets[key];
+    }
+
+    std::inclusive_scan(_offsets.begin(), _offsets.end(), _offsets.begin());
+
+    // Scatter back to front so each count ends up at the start of its cell and equal keys keep
+    // their original order.
+    for (size_t i = _keys.size(); i-- > 0;) {
+        _sortedIndices[--_offsets[_keys[i]]] = static_cast<uint32_t>(i);
+    }
+}
+
+void SPH::sortSpatialHash(const size_t thread)
+{
+    const size_t count = _particles.size();
+    const size_t start = std::min(thread * _chunk, count);
+    const size_t end = std::min(start + _chunk, count);
+
+    // Keys are below _keyCount, so only that many bits need sorting. Split them evenly into as few
+    // passes as MAX_RADIX_BITS allows.
+    const auto keyBits
+        = std::max<uint32_t>(1, static_cast<uint32_t>(std::bit_width(_keyCount - 1)));
+    const uint32_t passes = (keyBits + MAX_RADIX_BITS - 1) / MAX_RADIX_BITS;
+    const uint32_t digitBits = (keyBits + passes - 1) / passes;
+    const uint32_t radix = 1u << digitBits;
+
+    // Ping-pong between the two buffers, starting in whichever one makes the last pass land in
+    // _sortedKeys/_sortedIndices.
+    uint32_t* keys[2] = { _keys.data(), _sortedKeys.data() };
+    uint32_t* indices[2] = { _indexScratch.data(), _sortedIndices.data() };
+    size_t source = passes % 2 == 0 ? 1 : 0;
+
+    for (size_t i = start; i < end; ++i) {
+        keys[source][i] = cellKey(i);
+    }
+
+    std::array<uint32_t, MAX_RADIX> cursors {};
+    for (uint32_t pass = 0; pass < passes; ++pass) {
+        const uint32_t shift = pass * digitBits;
+        const uint32_t* sourceKeys = keys[source];
+        const uint32_t* sourceIndices = indices[source];
+        uint32_t* targetKeys = keys[source ^ 1];
+        uint32_t* targetIndices = indices[source ^ 1];
+
+        // Histogram this thread's chunk, stored digit-major so the scan below orders buckets by
+        // digit first and by thread second.
+        std::fill_n(cursors.begin(), radix, 0u);
+        for (size_t i = start; i < end; ++i) {
+            ++cursors[(sourceKeys[i] >> shift) & (radix - 1)];
+        }
+        for (uint32_t digit = 0; digit < radix; ++digit) {
+            _histograms[digit * _threadCount + thread] = cursors[digit];
+        }
+        waitForWorkers(thread);
 
-        std::ranges::fill(_offsets, static_cast<uint32_t>(_particles.size()));
+        exclusiveScan(thread, _histograms.data(), static_cast<size_t>(radix) * _threadCount);
 
-        for (uint32_t i = 0; i < _offsets.size(); ++i) {
-            if (const uint32_t k = _keys[i]; _offsets[k] > i)
-                _offsets[k] = i;
+        // Scatter in chunk order. Each thread owns its own bucket ranges, so the sort stays
+        // stable and needs no atomics.
+        for (uint32_t digit = 0; digit < radix; ++digit) {
+            cursors[digit] = _histograms[digit * _threadCount + thread];
+        }
+        for (size_t i = start; i < end; ++i) {
+            const uint32_t key = sourceKeys[i];
+            const uint32_t target = cursors[(key >> shift) & (radix - 1)]++;
+            targetKeys[target] = key;
+            targetIndices[target] = pass == 0 ? static_cast<uint32_t>(i) : sourceIndices[i];
         }
+        waitForWorkers(thread);
+
+        source ^= 1;
     }
+}
 
-    _barrier->arrive_and_wait();
+void SPH::exclusiveScan(const size_t thread, uint32_t* values, const size_t size)
+{
+    const size_t block = (size + _threadCount - 1) / _threadCount;
+    const size_t first = std::min(thread * block, size);
+    const size_t last = std::min(first + block, size);
 
-    // 3) Densities
-    calculateDensities(start, end);
-    _barrier->arrive_and_wait();
+    _blockSums[thread] = std::accumulate(values + first, values + last, 0u);
+    waitForWorkers(thread);
 
-    // 4) Pressure
-    calculatePressureForce(start, end);
+    const uint32_t base
+        = std::accumulate(_blockSums.begin(), _blockSums.begin() + thread, 0u);
+    std::exclusive_scan(values + first, values + last, values + first, base);
+    waitForWorkers(thread);
+}
 
-    if (_useViscosity) {
-        _barrier->arrive_and_wait();
+void SPH::buildOffsets(const size_t start, const size_t end)
+{
+    // Every cell whose key lies between the previous sorted key and this one starts here. Each
+    // entry is written by exactly one thread.
+    const size_t count = _particles.size();
+    for (size_t i = start; i < end; ++i) {
+        const uint32_t first = i == 0 ? 0 : _sortedKeys[i - 1] + 1;
+        for (uint32_t key = first; key <= _sortedKeys[i]; ++key) {
+            _offsets[key] = static_cast<uint32_t>(i);
+        }
+    }
 
-        for (auto it = start; it != end; ++it) {
-            uint32_t i = it - _particles.begin();
-            _velocitySnapshot[i] = _particles[i]._velocity;
+    if (start < end && end == count) {
+        for (size_t key = _sortedKeys[count - 1] + 1; key <= _keyCount; ++key) {
+            _offsets[key] = static_cast<uint32_t>(count);
         }
+    }
+}
 
-        calculateViscosity(start, end);
+float SPH::maxListDisplacement(const size_t start, const size_t end) const
+{
+    const Vec3Field& predicted = _particles._predicted;
+    float maxSquareDistance = 0.0f;
+    for (size_t i = start; i < end; ++i) {
+        const float dx = predicted._x[i] - _listPositions._x[i];
+        const float dy = predicted._y[i] - _listPositions._y[i];
+        const float dz = predicted._z[i] - _listPositions._z[i];
+        maxSquareDistance = std::max(maxSquareDistance, dx * dx + dy * dy + dz * dz);
     }
+    return maxSquareDistance;
+}
 
-    _barrier->arrive_and_wait();
+template <int Dimensions> void SPH::buildNeighborLists(const size_t thread)
+{
+    const size_t count = _particles.size();
+    const size_t start = std::min(thread * _chunk, count);
+    const size_t end = std::min(start + _chunk, count);
+    const float radius = _config.smoothingRadius + _config.neighborSkin;
+    const float squareRadius = radius * radius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+
+    // Lists are built in two passes over the grid, so they can be written straight into
+    // _neighbors: the first counts each particle's entries for the scan, the second fills them in.
+    auto forEachListed = [&](const size_t i, auto&& visit) {
+        forEachNeighborRange<Dimensions>(
+            i, [&](const uint32_t rangeFirst, const uint32_t rangeLast) {
+            for (uint32_t j = rangeFirst; j < rangeLast; ++j) {
+                const float dx = px[j] - px[i];
+                const float dy = py[j] - py[i];
+                const float dz = pz[j] - pz[i];
+                if (dx * dx + dy * dy + dz * dz <= squareRadius)
+                    visit(j);
+            }
+        });
+    };
+
+    for (size_t i = start; i < end; ++i) {
+        uint32_t listed = 0;
+        forEachListed(i, [&listed](uint32_t) { ++listed; });
+        _neighborOffsets[i] = listed;
+        _listPositions.set(i, _particles._predicted.get(i));
+    }
+    if (thread == 0)
+        _neighborOffsets[count] = 0;
+    waitForWorkers(thread);
 
-    // 5) Final integration
-    updatePositions(start, end);
-    _barrier->arrive_and_wait();
+    exclusiveScan(thread, _neighborOffsets.data(), count + 1);
+
+    // The first lists built for a cell size reserve twice their length, and later rebuilds never
+    // grow _neighbors, so steps stay allocation-free. Lists that no longer fit, such as after the
+    // fluid was squeezed into a smaller box, are skipped and the grid is searched until the next
+    // rebuild instead.
+    if (thread == 0) {
+        const size_t total = _neighborOffsets[count];
+        if (_neighborsCellSize != _cellSize) {
+            _neighborsCellSize = _cellSize;
+            _neighbors.reserve(2 * total);
+        }
+        _listsOverflowed = total > _neighbors.capacity();
+        if (!_listsOverflowed)
+            _neighbors.resize(total);
+    }
+    waitForWorkers(thread);
+    if (_listsOverflowed)
+        return;
+
+    for (size_t i = start; i < end; ++i) {
+        uint32_t* list = _neighbors.data() + _neighborOffsets[i];
+        forEachListed(i, [&list](const uint32_t j) { *list++ = j; });
+    }
+    waitForWorkers(thread);
 }
 
-void SPH::applyExternalForces(const auto start, const auto end)
+void SPH::reorderParticles(const size_t start, const size_t end)
 {
-    for (auto particleIt = start; particleIt != end; ++particleIt) {
-        auto& particle = *particleIt;
-        particle._velocity[1] += _config.gravity * _dt;
-        particle._predicted = particle._position + particle._velocity * _dt;
+    auto gather = [this, start, end](
+                      const AlignedVector<float>& source, AlignedVector<float>& target) {
+        for (size_t i = start; i < end; ++i)
+            target[i] = source[_sortedIndices[i]];
+    };
+    auto gatherField = [&gather](const Vec3Field& source, Vec3Field& target) {
+        gather(source._x, target._x);
+        gather(source._y, target._y);
+        gather(source._z, target._z);
+    };
+
+    gatherField(_particles._position, _reorderBuffer._position);
+    gatherField(_particles._predicted, _reorderBuffer._predicted);
+    gatherField(_particles._velocity, _reorderBuffer._velocity);
+    gather(_particles._density, _reorderBuffer._density);
+    gather(_particles._nearDensity, _reorderBuffer._nearDensity);
+    gather(_particles._pressure, _reorderBuffer._pressure);
+}
+
+template <typename Kernel> void SPH::calculateDensities(const size_t start, const size_t end)
+{
+    const KernelCoefficients densityKernel = _densityKernel;
+    const KernelCoefficients nearKernel = _nearKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+
+    for (size_t i = start; i < end; ++i) {
+        const float x = px[i];
+        const float y = py[i];
+        const float z = pz[i];
+        float density = 0.0f;
+        float nearDensity = 0.0f;
+
+        if (_kernels) {
+            const NeighborArrays arrays { px, py, pz };
+            NeighborQuery query { { x, y, z } };
+            forEachNeighborRange<Kernel::DIMENSIONS>(
+                i, [&](const uint32_t first, const uint32_t last) {
+                _kernels->_densities(_kernelConstants, arrays, first, last, query);
+            });
+            _particles._density[i] = query._density;
+            _particles._nearDensity[i] = query._nearDensity;
+            continue;
+        }
+
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            const float dx = px[j] - x;
+            const float dy = py[j] - y;
+            const float dz = pz[j] - z;
+            if (const float squareDistance = dx * dx + dy * dy + dz * dz;
+                squareDistance <= squareRadius) {
+                const float distance = std::sqrt(squareDistance);
+                density += Kernel::value(densityKernel, distance);
+                nearDensity += NearKernel<Kernel>::value(nearKernel, distance);
+            }
+        });
+
+        _particles._density[i] = density;
+        _particles._nearDensity[i] = nearDensity;
     }
 }
 
-void SPH::buildSpatialHash()
+template <typename Kernel>
+void SPH::calculateImplicitDensities(const size_t start, const size_t end)
 {
-    for (auto&& [particle, key] : std::views::zip(_particles, _keys)) {
-        key = keyFromHash(hash(getCell(particle)));
+    const KernelCoefficients densityKernel = _densityKernel;
+    const KernelCoefficients nearKernel = _nearKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* vx = _particles._velocity._x.data();
+    const float* vy = _particles._velocity._y.data();
+    const float* vz = _particles._velocity._z.data();
+    const float squareDt = _dt * _dt;
+    const float scale = squareDt / (_config.targetDensity * _config.targetDensity);
+
+    for (size_t i = start; i < end; ++i) {
+        const Vec3<float> position { px[i], py[i], pz[i] };
+        const Vec3<float> particleVelocity { vx[i], vy[i], vz[i] };
+        float density = 0.0f;
+        float nearDensity = 0.0f;
+        Vec3<float> gradientSum {};
+        float squareGradientSum = 0.0f;
+        float divergence = 0.0f;
+
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            const Vec3<float> distanceToNeighbor = Vec3<float> { px[j], py[j], pz[j] } - position;
+            if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                squareDistance <= squareRadius) {
+                const float distance = std::sqrt(squareDistance);
+                density += Kernel::value(densityKernel, distance);
+                nearDensity += NearKernel<Kernel>::value(nearKernel, distance);
+                if (distance <= 1e-6f)
+                    return;
+
+                // Gradient of the density kernel with respect to particle i.
+                const auto gradient = distanceToNeighbor
+                    * (-Kernel::derivative(densityKernel, distance) / distance);
+                gradientSum += gradient;
+                squareGradientSum += gradient * gradient;
+                divergence += (particleVelocity - Vec3<float> { vx[j], vy[j], vz[j] }) * gradient;
+            }
+        });
+
+        _particles._density[i] = density;
+        _particles._nearDensity[i] = nearDensity;
+        _selfDisplacement.set(i, gradientSum * -scale);
+        _pressureDiagonal[i] = -scale * (gradientSum * gradientSum + squareGradientSum);
+        _advectedDensity[i] = density + _dt * divergence;
+        _solverPressure[0][i] = 0.5f * _particles._pressure[i];
     }
+}
 
-    std::iota(_sortedIndices.begin(), _sortedIndices.end(), 0);
-    std::ranges::sort(
-        _sortedIndices, [this](const uint32_t a, const uint32_t b) { return _keys[a] < _keys[b]; });
+template <typename Kernel> size_t SPH::solvePressure(const size_t thread)
+{
+    const size_t count = _particles.size();
+    const float totalDensity = _config.targetDensity * static_cast<float>(count);
+    const float tolerance = _config.densityTolerance * totalDensity;
+    size_t first = 0;
+    size_t last = 0;
+    size_t source = 0;
+    int iteration = 0;
+    float error = 0.0f;
+
+    // Each pass refills the scheduler of the other one: it was drained before the barrier that
+    // started this pass, and is not taken from again until after the next one.
+    while (true) {
+        if (thread == 0)
+            _relaxBlocks.reset(count, SCHEDULER_BLOCK_SIZE);
+        while (_displacementBlocks.next(thread, first, last))
+            sumPressureDisplacements<Kernel>(first, last, source);
+        waitForWorkers(thread);
+
+        if (thread == 0)
+            _displacementBlocks.reset(count, SCHEDULER_BLOCK_SIZE);
+        float threadError = 0.0f;
+        while (_relaxBlocks.next(thread, first, last))
+            threadError += relaxPressures<Kernel>(first, last, source);
+        _densityErrors[thread] = threadError;
+        waitForWorkers(thread);
+
+        // Every worker sums the same values, so all of them agree on when to stop.
+        source ^= 1;
+        ++iteration;
+        error = std::accumulate(_densityErrors.begin(), _densityErrors.end(), 0.0f);
+        if ((iteration >= 2 && error <= tolerance) || iteration >= _config.maxPressureIterations)
+            break;
+    }
+
+    if (thread == 0) {
+        _finalPressure = source;
+        _pressureIterations = iteration;
+        _densityError = totalDensity > 0.0f ? error / totalDensity : 0.0f;
+    }
+    return source;
 }
 
-void SPH::reorderParticles()
+template <typename Kernel>
+void SPH::sumPressureDisplacements(const size_t start, const size_t end, const size_t source)
 {
-    const auto keysCopy(_keys);
-    for (auto&& [sortedIndex, key, buffer] :
-        std::views::zip(_sortedIndices, _keys, _reorderBuffer)) {
-        buffer = _particles[sortedIndex];
-        key = keysCopy[sortedIndex];
+    const KernelCoefficients densityKernel = _densityKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* pressures = _solverPressure[source].data();
+    const float scale = _dt * _dt / (_config.targetDensity * _config.targetDensity);
+
+    for (size_t i = start; i < end; ++i) {
+        const Vec3<float> position { px[i], py[i], pz[i] };
+        Vec3<float> displacement {};
+
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            const Vec3<float> distanceToNeighbor = Vec3<float> { px[j], py[j], pz[j] } - position;
+            if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                squareDistance <= squareRadius && squareDistance > 1e-12f) {
+                const float distance = std::sqrt(squareDistance);
+                const auto gradient = distanceToNeighbor
+                    * (-Kernel::derivative(densityKernel, distance) / distance);
+                displacement -= gradient * pressures[j];
+            }
+        });
+
+        _neighborDisplacement.set(i, displacement * scale);
+    }
+}
+
+template <typename Kernel>
+float SPH::relaxPressures(const size_t start, const size_t end, const size_t source)
+{
+    const KernelCoefficients densityKernel = _densityKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* pressures = _solverPressure[source].data();
+    float* nextPressures = _solverPressure[source ^ 1].data();
+    const float targetDensity = _config.targetDensity;
+    const float ownScale = _dt * _dt / (targetDensity * targetDensity);
+    // No single neighbor's pressure may accelerate a particle past the limit adaptive stepping
+    // puts on a whole frame. Targets the box cannot reach, or particles spawned on top of each
+    // other, would otherwise drive the iteration to ever larger pressures. The bound follows the
+    // frame rather than the substep, so shorter substeps do not raise it.
+    const float frameRate = 1.0f / _config.frameTime;
+    const float maxPressure = _config.forceNumber * _config.forceNumber * _config.smoothingRadius
+        * frameRate * frameRate * targetDensity * targetDensity / _densitySlope;
+    const float relaxation = _config.pressureRelaxation;
+    float error = 0.0f;
+
+    for (size_t i = start; i < end; ++i) {
+        const Vec3<float> position { px[i], py[i], pz[i] };
+        const Vec3<float> displacement = _neighborDisplacement.get(i);
+        const float pressure = pressures[i];
+        float neighborCompression = 0.0f;
+
+        // How much the neighbors' pressures compress particle i: its own displacement from them,
+        // minus each neighbor's displacement from every particle but i.
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            const Vec3<float> distanceToNeighbor = Vec3<float> { px[j], py[j], pz[j] } - position;
+            if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                squareDistance <= squareRadius && squareDistance > 1e-12f) {
+                const float distance = std::sqrt(squareDistance);
+                const auto gradient = distanceToNeighbor
+                    * (-Kernel::derivative(densityKernel, distance) / distance);
+                const auto neighborDisplacement = _selfDisplacement.get(j) * pressures[j]
+                    + _neighborDisplacement.get(j) - gradient * (ownScale * pressure);
+                neighborCompression += (displacement - neighborDisplacement) * gradient;
+            }
+        });
+
+        const float diagonal = _pressureDiagonal[i];
+        const float advected = _advectedDensity[i];
+        const float compression = advected + diagonal * pressure + neighborCompression;
+        error += std::max(compression - targetDensity, 0.0f);
+
+        // Pressure only pushes apart, so particles at the surface are never pulled together.
+        nextPressures[i] = diagonal < 0.0f
+            ? std::clamp((1.0f - relaxation) * pressure
+                      + relaxation / diagonal * (targetDensity - advected - neighborCompression),
+                  0.0f, maxPressure)
+            : 0.0f;
     }
-    _particles = _reorderBuffer;
+    return error;
 }
 
-void SPH::calculateDensities(const auto start, const auto end)
+template <typename Kernel>
+float SPH::calculateImplicitPressureForce(const size_t start, const size_t end, const size_t source)
 {
-    const float squareRadius = std::pow(_config.smoothingRadius, 2.0f);
+    const KernelCoefficients densityKernel = _densityKernel;
+    const KernelCoefficients nearKernel = _nearKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* densities = _particles._density.data();
+    const float* nearDensities = _particles._nearDensity.data();
+    const float* pressures = _solverPressure[source].data();
+    const float pressureScale = 1.0f / (_config.targetDensity * _config.targetDensity);
+    Vec3Field& velocity = _particles._velocity;
+    float maxAcceleration = 0.0f;
+
+    for (size_t i = start; i < end; ++i) {
+        const Vec3<float> position { px[i], py[i], pz[i] };
+        const float pressureTerm = pressures[i] * pressureScale;
+        const float nearPressure = nearPressureFromDensity(nearDensities[i]);
+        Vec3<float> acceleration {};
+        Vec3<float> nearForce {};
+        int neighborCount = 0;
+
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            if (j == i)
+                return;
+
+            const Vec3<float> distanceToNeighbor = Vec3<float> { px[j], py[j], pz[j] } - position;
+            if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                squareDistance <= squareRadius) {
+                ++neighborCount;
+                if (squareDistance <= 1e-12f)
+                    return;
+                const float distance = std::sqrt(squareDistance);
+                const auto direction = distanceToNeighbor / distance;
+                acceleration += direction
+                    * (Kernel::derivative(densityKernel, distance)
+                        * (pressureTerm + pressures[j] * pressureScale));
+
+                // The solver only keeps the density at its target; the near pressure still keeps
+                // particles from clumping in pairs, as it does with the state equation.
+                const float sharedNearPressure
+                    = (nearPressure + nearPressureFromDensity(nearDensities[j])) * 0.5f;
+                nearForce += direction * NearKernel<Kernel>::derivative(nearKernel, distance)
+                    * sharedNearPressure / std::max(1e-6f, nearDensities[j]);
+            }
+        });
 
-    for (auto particleIt = start; particleIt != end; ++particleIt) {
-        auto& particle = *particleIt;
-        const auto originCell = getCell(particle);
+        acceleration += nearForce * (1.0f / densities[i]);
+        maxAcceleration = std::max(maxAcceleration, acceleration * acceleration);
+        auto particleVelocity = velocity.get(i) + acceleration * _dt;
+
+        // Airborne drag, as with the state equation.
+        if (neighborCount < 8) {
+            particleVelocity -= particleVelocity * _dt * 0.75f;
+        }
+
+        velocity.set(i, particleVelocity);
+        if (_useViscosity)
+            _velocitySnapshot.set(i, particleVelocity);
+        _particles._pressure[i] = pressures[i];
+    }
+    return maxAcceleration;
+}
+
+template <typename Kernel>
+float SPH::calculateConstraints(const size_t start, const size_t end, const Vec3Field& positions)
+{
+    const KernelCoefficients densityKernel = _densityKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = positions._x.data();
+    const float* py = positions._y.data();
+    const float* pz = positions._z.data();
+    const float targetDensity = _config.targetDensity;
+    const float gradientScale = 1.0f / (targetDensity * targetDensity);
+    float error = 0.0f;
+
+    for (size_t i = start; i < end; ++i) {
+        const Vec3<float> position { px[i], py[i], pz[i] };
         float density = 0.0f;
-        float nearDensity = 0.0f;
+        Vec3<float> gradientSum {};
+        float squareGradientSum = 0.0f;
+
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            const Vec3<float> distanceToNeighbor = Vec3<float> { px[j], py[j], pz[j] } - position;
+            if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                squareDistance <= squareRadius) {
+                const float distance = std::sqrt(squareDistance);
+                density += Kernel::value(densityKernel, distance);
+                if (distance <= 1e-6f)
+                    return;
+
+                const auto gradient = distanceToNeighbor
+                    * (-Kernel::derivative(densityKernel, distance) / distance);
+                gradientSum += gradient;
+                squareGradientSum += gradient * gradient;
+            }
+        });
+
+        // Only compression is corrected, so particles at the surface are never pulled together.
+        const float constraint = std::max(density / targetDensity - 1.0f, 0.0f);
+        _lambda[i] = -constraint
+            / ((gradientSum * gradientSum + squareGradientSum) * gradientScale
+                + _config.constraintSoftness);
+        _particles._density[i] = density;
+        error += std::max(density - targetDensity, 0.0f);
+    }
+    return error;
+}
 
-        for (const auto offset : OFFSETS_3D) {
-            const auto cell = originCell + offset;
-            const uint32_t key = keyFromHash(hash(cell));
-            uint32_t neighborIndex = _offsets[key];
-
-            while (neighborIndex < _particles.size() && _keys[neighborIndex] == key) {
-                const auto distanceToNeighbor
-                    = _particles[neighborIndex]._predicted - particle._predicted;
-                const float squareDistance = distanceToNeighbor * distanceToNeighbor;
-                ++neighborIndex;
-                if (squareDistance <= squareRadius) {
-                    const float distance = distanceToNeighbor.norm();
-                    density += densityKernel(distance);
-                    nearDensity += nearDensityKernel(distance);
-                }
+template <typename Kernel> size_t SPH::projectConstraints(const size_t thread)
+{
+    const size_t count = _particles.size();
+    const int iterations = std::max(_config.constraintIterations, 1);
+    const Vec3Field* positions = &_particles._predicted;
+    size_t target = 0;
+    size_t first = 0;
+    size_t last = 0;
+
+    // As in solvePressure, each pass refills the scheduler of the other one.
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        if (iteration > 0) {
+            if (thread == 0)
+                _displacementBlocks.reset(count, SCHEDULER_BLOCK_SIZE);
+            float threadError = 0.0f;
+            while (_relaxBlocks.next(thread, first, last))
+                threadError += calculateConstraints<Kernel>(first, last, *positions);
+            _densityErrors[thread] = threadError;
+            waitForWorkers(thread);
+        }
+
+        if (thread == 0)
+            _relaxBlocks.reset(count, SCHEDULER_BLOCK_SIZE);
+        while (_displacementBlocks.next(thread, first, last))
+            projectPositions<Kernel>(first, last, *positions, _projected[target]);
+        waitForWorkers(thread);
+
+        positions = &_projected[target];
+        target ^= 1;
+    }
+
+    if (thread == 0) {
+        const float totalDensity = _config.targetDensity * static_cast<float>(count);
+        const float error = std::accumulate(_densityErrors.begin(), _densityErrors.end(), 0.0f);
+        _finalProjection = target ^ 1;
+        _pressureIterations = iterations;
+        _densityError = totalDensity > 0.0f ? error / totalDensity : 0.0f;
+    }
+    return target ^ 1;
+}
+
+template <typename Kernel>
+void SPH::projectPositions(
+    const size_t start, const size_t end, const Vec3Field& from, Vec3Field& to)
+{
+    const KernelCoefficients densityKernel = _densityKernel;
+    const float radius = _config.smoothingRadius;
+    const float squareRadius = radius * radius;
+    const float* px = from._x.data();
+    const float* py = from._y.data();
+    const float* pz = from._z.data();
+    const float* lambdas = _lambda.data();
+    const float inverseTarget = 1.0f / _config.targetDensity;
+    // Artificial pressure, relative to the kernel at a fifth of the radius.
+    const float correctionScale = 1.0f / Kernel::value(densityKernel, 0.2f * radius);
+    const float tensileCorrection = _config.tensileCorrection;
+
+    for (size_t i = start; i < end; ++i) {
+        const Vec3<float> position { px[i], py[i], pz[i] };
+        Vec3<float> correction {};
+
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            if (j == i)
+                return;
+
+            const Vec3<float> distanceToNeighbor = Vec3<float> { px[j], py[j], pz[j] } - position;
+            if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                squareDistance <= squareRadius && squareDistance > 1e-12f) {
+                const float distance = std::sqrt(squareDistance);
+                const float ratio = Kernel::value(densityKernel, distance) * correctionScale;
+                const float artificialPressure = -tensileCorrection * ratio * ratio * ratio * ratio;
+                correction += distanceToNeighbor
+                    * (-Kernel::derivative(densityKernel, distance) / distance
+                        * (lambdas[i] + lambdas[j] + artificialPressure));
             }
+        });
+
+        Vec3<float> projected = position + correction * inverseTarget;
+        for (size_t axis = 0; axis < 3; ++axis) {
+            const float halfBound = _config.bounds[axis];
+            projected[axis] = std::clamp(projected[axis], -halfBound, halfBound);
         }
+        to.set(i, projected);
+    }
+}
 
-        particle._density = density;
-        particle._nearDensity = nearDensity;
+float SPH::updateProjectedVelocities(
+    const size_t start, const size_t end, const Vec3Field& projected)
+{
+    const Vec3Field& position = _particles._position;
+    Vec3Field& velocity = _particles._velocity;
+    const float inverseDt = 1.0f / _dt;
+    float maxAcceleration = 0.0f;
+
+    for (size_t i = start; i < end; ++i) {
+        const Vec3<float> particleVelocity = (projected.get(i) - position.get(i)) * inverseDt;
+        const Vec3<float> acceleration = (particleVelocity - velocity.get(i)) * inverseDt;
+        maxAcceleration = std::max(maxAcceleration, acceleration * acceleration);
+        velocity.set(i, particleVelocity);
+        if (_useViscosity)
+            _velocitySnapshot.set(i, particleVelocity);
     }
+    return maxAcceleration;
 }
 
-void SPH::calculatePressureForce(const auto start, const auto end)
+template <typename Kernel> float SPH::calculatePressureForce(const size_t start, const size_t end)
 {
-    const float squareRadius = std::pow(_config.smoothingRadius, 2.0f);
+    const KernelCoefficients densityKernel = _densityKernel;
+    const KernelCoefficients nearKernel = _nearKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* densities = _particles._density.data();
+    const float* nearDensities = _particles._nearDensity.data();
+    const NeighborArrays arrays { px, py, pz, densities, nearDensities };
+    Vec3Field& velocity = _particles._velocity;
+    float maxAcceleration = 0.0f;
+
+    for (size_t i = start; i < end; ++i) {
+        const float pressure = pressureFromDensity(densities[i]);
+        const float nearPressure = nearPressureFromDensity(nearDensities[i]);
+        const Vec3<float> position { px[i], py[i], pz[i] };
+        Vec3<float> pressureForce {};
+        int neighborCount = 0;
+
+        if (_kernels) {
+            NeighborQuery query { { px[i], py[i], pz[i] }, pressure, nearPressure };
+            const auto index = static_cast<uint32_t>(i);
+            forEachNeighborRange<Kernel::DIMENSIONS>(
+                i, [&](const uint32_t first, const uint32_t last) {
+                // The particle lies in one of its own ranges; leave it out.
+                if (index >= first && index < last) {
+                    _kernels->_pressureForce(_kernelConstants, arrays, first, index, query);
+                    _kernels->_pressureForce(_kernelConstants, arrays, index + 1, last, query);
+                } else {
+                    _kernels->_pressureForce(_kernelConstants, arrays, first, last, query);
+                }
+            });
+            pressureForce = { query._force[0], query._force[1], query._force[2] };
+            neighborCount = static_cast<int>(query._neighborCount);
+        } else {
+            forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+                if (j == i)
+                    return;
+
+                const Vec3<float> distanceToNeighbor
+                    = Vec3<float> { px[j], py[j], pz[j] } - position;
+
+                if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                    squareDistance <= squareRadius) {
+                    const float sharedPressure
+                        = (pressure + pressureFromDensity(densities[j])) * 0.5f;
+                    const float sharedNearPressure
+                        = (nearPressure + nearPressureFromDensity(densities[j])) * 0.5f;
+
+                    const float dstToNeighbor = std::sqrt(squareDistance);
+                    const auto dirToNeighbor = dstToNeighbor > 1e-6f
+                        ? distanceToNeighbor / dstToNeighbor
+                        : Vec3<float> {};
+
+                    pressureForce += dirToNeighbor
+                        * Kernel::derivative(densityKernel, dstToNeighbor) * sharedPressure
+                        / densities[j];
+
+                    pressureForce += dirToNeighbor
+                        * NearKernel<Kernel>::derivative(nearKernel, dstToNeighbor)
+                        * sharedNearPressure / std::max(1e-6f, nearDensities[j]);
+
+                    ++neighborCount;
+                }
+            });
+        }
+
+        const auto acceleration = pressureForce * (1.0f / std::max(1e-6f, densities[i]));
+        maxAcceleration = std::max(maxAcceleration, acceleration * acceleration);
+        auto particleVelocity = velocity.get(i) + acceleration * _dt;
+
+        // Airborne drag
+        if (neighborCount < 8) {
+            particleVelocity -= particleVelocity * _dt * 0.75f;
+        }
+
+        velocity.set(i, particleVelocity);
+        if (_useViscosity)
+            _velocitySnapshot.set(i, particleVelocity);
+    }
+    return maxAcceleration;
+}
 
-    for (auto particleIt = start; particleIt != end; ++particleIt) {
-        auto& particle = *particleIt;
-        const float pressure = pressureFromDensity(particle._density);
-        const float nearPressure = nearPressureFromDensity(particle._nearDensity);
+template <typename Kernel> float SPH::calculateForces(const size_t start, const size_t end)
+{
+    const KernelCoefficients densityKernel = _densityKernel;
+    const KernelCoefficients nearKernel = _nearKernel;
+    const KernelCoefficients viscosityKernel = _viscosityKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* vx = _particles._velocity._x.data();
+    const float* vy = _particles._velocity._y.data();
+    const float* vz = _particles._velocity._z.data();
+    const float* densities = _particles._density.data();
+    const float* nearDensities = _particles._nearDensity.data();
+    float maxAcceleration = 0.0f;
+
+    for (size_t i = start; i < end; ++i) {
+        const float pressure = pressureFromDensity(densities[i]);
+        const float nearPressure = nearPressureFromDensity(nearDensities[i]);
+        const Vec3<float> position { px[i], py[i], pz[i] };
+        const Vec3<float> velocity { vx[i], vy[i], vz[i] };
         Vec3<float> pressureForce {};
-        const auto originCell = getCell(particle);
+        Vec3<float> viscosityForce {};
         int neighborCount = 0;
 
-        for (const auto offset : OFFSETS_3D) {
-            const auto cell = originCell + offset;
-            const uint32_t key = keyFromHash(hash(cell));
-            uint32_t neighborIndex = _offsets[key];
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            if (j == i)
+                return;
+
+            const Vec3<float> distanceToNeighbor = Vec3<float> { px[j], py[j], pz[j] } - position;
 
-            while (neighborIndex < _particles.size() && _keys[neighborIndex] == key) {
-                ++neighborIndex;
+            if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                squareDistance <= squareRadius) {
+                const float sharedPressure = (pressure + pressureFromDensity(densities[j])) * 0.5f;
+                const float sharedNearPressure
+                    = (nearPressure + nearPressureFromDensity(densities[j])) * 0.5f;
 
-                if (auto& neighbor = _particles[neighborIndex]; neighbor != particle) {
+                const float dstToNeighbor = std::sqrt(squareDistance);
+                const auto dirToNeighbor = dstToNeighbor > 1e-6f
+                    ? distanceToNeighbor / dstToNeighbor
+                    : Vec3<float> {};
 
-                    const auto distanceToNeighbor = neighbor._predicted - particle._predicted;
+                pressureForce += dirToNeighbor * Kernel::derivative(densityKernel, dstToNeighbor)
+                    * sharedPressure / densities[j];
 
-                    if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
-                        squareDistance <= squareRadius) {
-                        const float sharedPressure
-                            = (pressure + pressureFromDensity(neighbor._density)) * 0.5f;
-                        const float sharedNearPressure
-                            = (nearPressure + nearPressureFromDensity(neighbor._density)) * 0.5f;
+                pressureForce += dirToNeighbor
+                    * NearKernel<Kernel>::derivative(nearKernel, dstToNeighbor)
+                    * sharedNearPressure / std::max(1e-6f, nearDensities[j]);
 
-                        const float dstToNeighbor = std::sqrt(squareDistance);
-                        const auto dirToNeighbor = dstToNeighbor > 1e-6f
-                            ? distanceToNeighbor / dstToNeighbor
-                            : Vec3<float> {};
+                viscosityForce += (Vec3<float> { vx[j], vy[j], vz[j] } - velocity)
+                    * ViscosityKernel<Kernel>::value(viscosityKernel, dstToNeighbor);
 
-                        pressureForce += dirToNeighbor * densityDerivative(dstToNeighbor)
-                            * sharedPressure / neighbor._density;
+                ++neighborCount;
+            }
+        });
 
-                        pressureForce += dirToNeighbor * nearDensityDerivative(dstToNeighbor)
-                            * sharedNearPressure / std::max(1e-6f, neighbor._nearDensity);
+        const auto acceleration = pressureForce * (1.0f / std::max(1e-6f, densities[i]));
+        maxAcceleration = std::max(maxAcceleration, acceleration * acceleration);
+        auto particleVelocity = velocity + acceleration * _dt;
 
-                        ++neighborCount;
-                    }
+        // Airborne drag
+        if (neighborCount < 8) {
+            particleVelocity -= particleVelocity * _dt * 0.75f;
+        }
+
+        // Neighbors still read this particle's old velocity, so the new one waits in the snapshot.
+        _velocitySnapshot.set(
+            i, particleVelocity + viscosityForce * _config.viscosityStrength * _dt);
+    }
+    return maxAcceleration;
+}
+
+template <typename Kernel> float SPH::calculatePressureForcePairs(const size_t thread)
+{
+    const KernelCoefficients densityKernel = _densityKernel;
+    const KernelCoefficients nearKernel = _nearKernel;
+    const size_t count = _particles.size();
+    const size_t start = std::min(thread * _chunk, count);
+    const size_t end = std::min(start + _chunk, count);
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* densities = _particles._density.data();
+    const float* nearDensities = _particles._nearDensity.data();
+    Vec3Field& velocity = _particles._velocity;
+    PairAccumulator& accumulator = _pairAccumulators[thread];
+    accumulator._first = count;
+    accumulator._last = 0;
+
+    size_t first = 0;
+    size_t last = 0;
+    while (_pressureBlocks.next(thread, first, last)) {
+        for (size_t i = first; i < last; ++i) {
+            const float density = densities[i];
+            const float pressure = pressureFromDensity(density);
+            const float nearPressure = nearPressureFromDensity(nearDensities[i]);
+            const float nearDensity = std::max(1e-6f, nearDensities[i]);
+            const Vec3<float> position { px[i], py[i], pz[i] };
+            Vec3<float> pressureForce {};
+            uint32_t neighborCount = 0;
+
+            forEachNeighborPair<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+                const Vec3<float> distanceToNeighbor
+                    = Vec3<float> { px[j], py[j], pz[j] } - position;
+
+                if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
+                    squareDistance <= squareRadius) {
+                    const float sharedPressure
+                        = (pressure + pressureFromDensity(densities[j])) * 0.5f;
+                    // Each side mixes its own near pressure with the other side's density, so the
+                    // near term differs between the two particles of a pair.
+                    const float sharedNearPressure
+                        = (nearPressure + nearPressureFromDensity(densities[j])) * 0.5f;
+                    const float neighborNearPressure = nearPressureFromDensity(nearDensities[j]);
+                    const float neighborSharedNearPressure
+                        = (neighborNearPressure + nearPressureFromDensity(density)) * 0.5f;
+
+                    const float dstToNeighbor = std::sqrt(squareDistance);
+                    const auto dirToNeighbor = dstToNeighbor > 1e-6f
+                        ? distanceToNeighbor / dstToNeighbor
+                        : Vec3<float> {};
+                    const float slope
+                        = Kernel::derivative(densityKernel, dstToNeighbor) * sharedPressure;
+                    const float nearSlope
+                        = NearKernel<Kernel>::derivative(nearKernel, dstToNeighbor);
+
+                    pressureForce += dirToNeighbor
+                        * (slope / densities[j]
+                            + nearSlope * sharedNearPressure / std::max(1e-6f, nearDensities[j]));
+                    const auto neighborForce = dirToNeighbor
+                        * (slope / density + nearSlope * neighborSharedNearPressure / nearDensity);
+                    accumulator.add(j, neighborForce * -1.0f, 1);
+                    ++neighborCount;
                 }
-            }
+            });
+
+            accumulator.add(i, pressureForce, neighborCount);
         }
+    }
+    waitForWorkers(thread);
 
-        const auto acceleration = pressureForce * (1.0f / std::max(1e-6f, particle._density));
-        particle._velocity += acceleration * _dt;
+    float maxAcceleration = 0.0f;
+    for (size_t i = start; i < end; ++i) {
+        uint32_t neighborCount = 0;
+        const Vec3<float> pressureForce = takePairForce(i, neighborCount);
+        const auto acceleration = pressureForce * (1.0f / std::max(1e-6f, densities[i]));
+        maxAcceleration = std::max(maxAcceleration, acceleration * acceleration);
+        auto particleVelocity = velocity.get(i) + acceleration * _dt;
 
         // Airborne drag
         if (neighborCount < 8) {
-            particle._velocity -= particle._velocity * _dt * 0.75f;
+            particleVelocity -= particleVelocity * _dt * 0.75f;
         }
+
+        velocity.set(i, particleVelocity);
+        if (_useViscosity)
+            _velocitySnapshot.set(i, particleVelocity);
     }
+    return maxAcceleration;
 }
 
-void SPH::calculateViscosity(const auto start, const auto end)
+template <typename Kernel> void SPH::calculateViscosity(const size_t start, const size_t end)
 {
-    const float squareRadius = std::pow(_config.smoothingRadius, 2.0f);
-
-    for (auto particleIt = start; particleIt != end; ++particleIt) {
-        const uint32_t id = particleIt - _particles.begin();
-        auto& particle = *particleIt;
-        const auto originCell = getCell(particle);
+    const KernelCoefficients viscosityKernel = _viscosityKernel;
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* vx = _velocitySnapshot._x.data();
+    const float* vy = _velocitySnapshot._y.data();
+    const float* vz = _velocitySnapshot._z.data();
+    Vec3Field& velocity = _particles._velocity;
+
+    for (size_t i = start; i < end; ++i) {
         Vec3<float> viscosityForce {};
-        const auto velocity = _velocitySnapshot[id];
-
-        for (const auto offset : OFFSETS_3D) {
-            const auto cell = originCell + offset;
-            const uint32_t key = keyFromHash(hash(cell));
-            uint32_t neighborIndex = _offsets[key];
 
-            while (neighborIndex < _particles.size() && _keys[neighborIndex] == key) {
-                ++neighborIndex;
+        forEachNeighbor<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+            if (j == i)
+                return;
+
+            const float dx = px[j] - px[i];
+            const float dy = py[j] - py[i];
+            const float dz = pz[j] - pz[i];
+            if (const float squareDistance = dx * dx + dy * dy + dz * dz;
+                squareDistance <= squareRadius) {
+                const float kernel
+                    = ViscosityKernel<Kernel>::value(viscosityKernel, std::sqrt(squareDistance));
+                viscosityForce
+                    += Vec3<float> { vx[j] - vx[i], vy[j] - vy[i], vz[j] - vz[i] } * kernel;
+            }
+        });
 
-                if (auto& neighbor = _particles[neighborIndex]; neighbor != particle) {
-                    const auto distanceToNeighbor = neighbor._predicted - particle._predicted;
+        velocity.set(i, velocity.get(i) + viscosityForce * _config.viscosityStrength * _dt);
+    }
+}
 
-                    if (const float squareDistance = distanceToNeighbor * distanceToNeighbor;
-                        squareDistance <= squareRadius) {
-                        const float distance = std::sqrt(squareDistance);
-                        viscosityForce += (_velocitySnapshot[neighborIndex] - velocity)
-                            * poly6Kernel(distance);
-                    }
+template <typename Kernel> void SPH::calculateViscosityPairs(const size_t thread)
+{
+    const KernelCoefficients viscosityKernel = _viscosityKernel;
+    const size_t count = _particles.size();
+    const size_t start = std::min(thread * _chunk, count);
+    const size_t end = std::min(start + _chunk, count);
+    const float squareRadius = _config.smoothingRadius * _config.smoothingRadius;
+    const float* px = _particles._predicted._x.data();
+    const float* py = _particles._predicted._y.data();
+    const float* pz = _particles._predicted._z.data();
+    const float* vx = _velocitySnapshot._x.data();
+    const float* vy = _velocitySnapshot._y.data();
+    const float* vz = _velocitySnapshot._z.data();
+    Vec3Field& velocity = _particles._velocity;
+    PairAccumulator& accumulator = _pairAccumulators[thread];
+    accumulator._first = count;
+    accumulator._last = 0;
+
+    size_t first = 0;
+    size_t last = 0;
+    while (_viscosityBlocks.next(thread, first, last)) {
+        for (size_t i = first; i < last; ++i) {
+            Vec3<float> viscosityForce {};
+
+            forEachNeighborPair<Kernel::DIMENSIONS>(i, [&](const uint32_t j) {
+                const float dx = px[j] - px[i];
+                const float dy = py[j] - py[i];
+                const float dz = pz[j] - pz[i];
+                if (const float squareDistance = dx * dx + dy * dy + dz * dz;
+                    squareDistance <= squareRadius) {
+                    const float kernel = ViscosityKernel<Kernel>::value(
+                        viscosityKernel, std::sqrt(squareDistance));
+                    const auto pairForce
+                        = Vec3<float> { vx[j] - vx[i], vy[j] - vy[i], vz[j] - vz[i] } * kernel;
+                    viscosityForce += pairForce;
+                    accumulator.add(j, pairForce * -1.0f, 0);
                 }
-            }
+            });
+
+            accumulator.add(i, viscosityForce, 0);
         }
+    }
+    waitForWorkers(thread);
 
-        _particles[id]._velocity += viscosityForce * _config.viscosityStrength * _dt;
+    for (size_t i = start; i < end; ++i) {
+        uint32_t neighborCount = 0;
+        const Vec3<float> viscosityForce = takePairForce(i, neighborCount);
+        velocity.set(i, velocity.get(i) + viscosityForce * _config.viscosityStrength * _dt);
+    }
+}
+
+Vec3<float> SPH::takePairForce(const size_t index, uint32_t& neighborCount)
+{
+    Vec3<float> force {};
+    for (auto& accumulator : _pairAccumulators) {
+        if (index < accumulator._first || index >= accumulator._last)
+            continue;
+
+        force += accumulator._force.get(index);
+        neighborCount += accumulator._count[index];
+        accumulator._force.set(index, {});
+        accumulator._count[index] = 0;
     }
+    return force;
 }
 
-void SPH::updatePositions(const auto start, const auto end)
+float SPH::updatePositions(const size_t start, const size_t end)
 {
-    for (auto particleIt = start; particleIt != end; ++particleIt) {
-        auto& particle = *particleIt;
-        particle._position += particle._velocity * _dt;
-        resolveCollisions(particle);
+    Vec3Field& position = _particles._position;
+    Vec3Field& velocity = _particles._velocity;
+    float maxSpeed = 0.0f;
+
+    for (size_t i = start; i < end; ++i) {
+        if (_fusedForces)
+            velocity.set(i, _velocitySnapshot.get(i));
+        position._x[i] += velocity._x[i] * _dt;
+        position._y[i] += velocity._y[i] * _dt;
+        position._z[i] += velocity._z[i] * _dt;
+        resolveCollisions(i);
+        const Vec3<float> particleVelocity = velocity.get(i);
+        maxSpeed = std::max(maxSpeed, particleVelocity * particleVelocity);
     }
+
+    // Only the state at the end of the frame is drawn.
+    if (_instanceSink._positions && _finalSubstep) {
+        for (size_t i = start; i < end; ++i) {
+            const Vec3<float> particlePosition = position.get(i);
+            const Vec3<float> color = Particle::color(velocity.get(i));
+            for (size_t axis = 0; axis < 3; ++axis) {
+                _instanceSink._positions[i * 3 + axis] = particlePosition[axis];
+                _instanceSink._colors[i * 3 + axis] = color[axis];
+            }
+        }
+    }
+    return maxSpeed;
+}
+
+float restDensity(SPHConfig config, const std::vector<Particle>& particles)
+{
+    if (particles.empty())
+        return config.targetDensity;
+
+    config.pressureSolver = PressureSolver::StateEquation;
+    config.adaptiveTimestep = false;
+    SPH& sph = SPH::getInstance();
+    sph.init(config, particles);
+    sph.step();
+
+    const ParticleView view = sph.particles();
+    std::vector<float> densities(view.size());
+    for (size_t i = 0; i < densities.size(); ++i)
+        densities[i] = view.density(i);
+    const auto median = densities.begin() + static_cast<std::ptrdiff_t>(densities.size() / 2);
+    std::ranges::nth_element(densities, median);
+    return *median;
+}
+
+SPHConfig planarConfig(SPHConfig config, const float depth)
+{
+    // A sphere of radius r holds 4/3 pi r^3 n / (A depth) of the particles spread through the box,
+    // and a disc of radius r' holds pi r'^2 n / A of the same particles on the plane.
+    const float radius = config.smoothingRadius;
+    const float scale = std::sqrt(4.0f * radius / (3.0f * depth));
+    config.dimensions = 2;
+    config.smoothingRadius *= scale;
+    config.neighborSkin *= scale;
+    config.gravity *= scale;
+    config.pressureMultiplier *= scale * scale;
+    config.nearPressureMultiplier *= scale * scale;
+    config.viscosityStrength *= scale * scale * scale;
+    return config;
 }
@@ -0,0 +1,66 @@
+#include "Math/SpaceFillingCurves.h"
+#include <span>
+
+uint32_t mortonIndex(const Vec3<int>& cell, const uint32_t bits, const int dimensions)
+{
+    // Spread the low 10 bits of a coordinate so two zero bits follow each one, or the low 16 so
+    // one zero bit does in 2D.
+    const uint32_t mask = (1u << bits) - 1;
+    if (dimensions == 2) {
+        auto spread = [mask](const int coordinate) {
+            uint32_t v = static_cast<uint32_t>(coordinate) & mask;
+            v = (v | v << 8) & 0x00FF00FFu;
+            v = (v | v << 4) & 0x0F0F0F0Fu;
+            v = (v | v << 2) & 0x33333333u;
+            v = (v | v << 1) & 0x55555555u;
+            return v;
+        };
+        return spread(cell[0]) << 1 | spread(cell[1]);
+    }
+
+    auto spread = [mask](const int coordinate) {
+        uint32_t v = static_cast<uint32_t>(coordinate) & mask;
+        v = (v | v << 16) & 0x030000FFu;
+        v = (v | v << 8) & 0x0300F00Fu;
+        v = (v | v << 4) & 0x030C30C3u;
+        v = (v | v << 2) & 0x09249249u;
+        return v;
+    };
+    return spread(cell[0]) << 2 | spread(cell[1]) << 1 | spread(cell[2]);
+}
+
+uint32_t hilbertIndex(const Vec3<int>& cell, const uint32_t bits, const int dimensions)
+{
+    // Skilling's transform from axes to the transposed Hilbert index, then interleave the bits.
+    // It works on any number of axes, so 2D takes the first two.
+    const uint32_t mask = (1u << bits) - 1;
+    uint32_t axes[3] = { static_cast<uint32_t>(cell[0]) & mask,
+        static_cast<uint32_t>(cell[1]) & mask, static_cast<uint32_t>(cell[2]) & mask };
+    const std::span<uint32_t> used(axes, static_cast<size_t>(dimensions));
+
+    for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1) {
+        const uint32_t p = q - 1;
+        for (auto& axis : used) {
+            if (axis & q) {
+                used[0] ^= p;
+            } else {
+                const uint32_t t = (used[0] ^ axis) & p;
+                used[0] ^= t;
+                axis ^= t;
+            }
+        }
+    }
+
+    for (size_t axis = 1; axis < used.size(); ++axis)
+        used[axis] ^= used[axis - 1];
+    uint32_t t = 0;
+    for (uint32_t q = 1u << (bits - 1); q > 1; q >>= 1) {
+        if (used.back() & q)
+            t ^= q - 1;
+    }
+    for (auto& axis : used) {
+        axis ^= t;
+    }
+
+    return mortonIndex(Vec3<int>(axes[0], axes[1], axes[2]), bits, dimensions);
+}
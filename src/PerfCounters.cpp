@@ -0,0 +1,103 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+CounterValues& CounterValues::operator+=(const CounterValues& other)
+{
+    _cycles += other._cycles;
+    _instructions += other._instructions;
+    _cacheMisses += other._cacheMisses;
+    _branchMisses += other._branchMisses;
+    return *this;
+}
+
+CounterValues CounterValues::operator-(const CounterValues& other) const
+{
+    return { _cycles - other._cycles, _instructions - other._instructions,
+        _cacheMisses - other._cacheMisses, _branchMisses - other._branchMisses };
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+#ifdef __linux__
+bool PerfCounters::open()
+{
+    close();
+
+    // In the order of the CounterValues fields, which is also the order a group read returns.
+    constexpr std::array<uint64_t, 4> events { PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+    for (size_t i = 0; i < events.size(); ++i) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = events[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // pid 0 and cpu -1 count the calling thread on whichever CPU it runs.
+        const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : _fds[0], 0);
+        if (fd < 0) {
+            close();
+            return false;
+        }
+        _fds[i] = static_cast<int>(fd);
+    }
+    _thread = std::this_thread::get_id();
+    return true;
+}
+
+bool PerfCounters::read(CounterValues& values) const
+{
+    if (_fds[0] < 0)
+        return false;
+
+    struct {
+        uint64_t _count;
+        uint64_t _values[4];
+    } group {};
+    if (::read(_fds[0], &group, sizeof(group)) != static_cast<ssize_t>(sizeof(group))
+        || group._count != 4) {
+        return false;
+    }
+    values = { group._values[0], group._values[1], group._values[2], group._values[3] };
+    return true;
+}
+
+void PerfCounters::close()
+{
+    for (int& fd : _fds) {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+    _thread = {};
+}
+#else
+bool PerfCounters::open()
+{
+    return false;
+}
+
+bool PerfCounters::read(CounterValues&) const
+{
+    return false;
+}
+
+void PerfCounters::close() { }
+#endif
+
+bool PerfCounters::countsCallingThread() const
+{
+    return _fds[0] >= 0 && _thread == std::this_thread::get_id();
+}
@@ -0,0 +1,198 @@
+#include "Simulation.h"
+#include "Particle.h"
+#include "Tracer.h"
+#include <chrono>
+#include <utility>
+
+Simulation& Simulation::getInstance()
+{
+    static Simulation instance;
+    return instance;
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start()
+{
+    if (_running)
+        return;
+
+    SPH& sph = SPH::getInstance();
+    _config = sph.config();
+    _configPending = false;
+
+    const size_t count = sph.particles().size();
+    for (uint32_t slot = 0; slot < _snapshots.size(); ++slot) {
+        SimulationSnapshot& snapshot = _snapshots[slot];
+        snapshot._slot = slot;
+        if (_externalPositions[slot] && _externalCapacity >= count) {
+            snapshot._storage.clear();
+            snapshot._positions = _externalPositions[slot];
+            snapshot._colors = _externalColors[slot];
+        } else {
+            snapshot._storage.resize(count * 6);
+            snapshot._positions = snapshot._storage.data();
+            snapshot._colors = snapshot._storage.data() + count * 3;
+        }
+    }
+
+    // Publish the initial state so the first frame has something to draw.
+    copyParticles();
+    publish();
+    acquireSnapshot();
+
+    _running = true;
+    _thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    _running = false;
+    if (_thread.joinable())
+        _thread.join();
+    SPH::getInstance().setInstanceSink({});
+}
+
+void Simulation::setSnapshotStorage(const std::array<float*, 3>& positions,
+    const std::array<float*, 3>& colors, const size_t capacity)
+{
+    _externalPositions = positions;
+    _externalColors = colors;
+    _externalCapacity = capacity;
+}
+
+void Simulation::setReleaseHandler(std::function<void(uint32_t slot)> handler)
+{
+    _releaseHandler = std::move(handler);
+}
+
+const SimulationSnapshot& Simulation::acquireSnapshot()
+{
+    if (_ready.load(std::memory_order_relaxed) & FRESH) {
+        if (_releaseHandler)
+            _releaseHandler(_readIndex);
+        _readIndex = _ready.exchange(_readIndex, std::memory_order_acq_rel) & ~FRESH;
+    }
+    return _snapshots[_readIndex];
+}
+
+const SimulationSnapshot& Simulation::snapshot() const
+{
+    return _snapshots[_readIndex];
+}
+
+void Simulation::setConfig(const SPHConfig& config)
+{
+    const std::lock_guard lock(_configMutex);
+    _config = config;
+    _configPending = true;
+}
+
+SPHConfig Simulation::config() const
+{
+    const std::lock_guard lock(_configMutex);
+    return _config;
+}
+
+void Simulation::setTargetStepsPerSecond(const float stepsPerSecond)
+{
+    _targetStepsPerSecond = stepsPerSecond;
+}
+
+float Simulation::targetStepsPerSecond() const
+{
+    return _targetStepsPerSecond;
+}
+
+void Simulation::run()
+{
+    using Clock = std::chrono::steady_clock;
+    SPH& sph = SPH::getInstance();
+    auto nextStep = Clock::now();
+    auto rateStart = nextStep;
+    uint64_t rateSteps = 0;
+    Tracer::setThreadName("Simulation");
+
+    while (_running) {
+        {
+            const std::lock_guard lock(_configMutex);
+            if (_configPending) {
+                sph.setConfig(_config);
+                _configPending = false;
+            }
+        }
+
+        const SimulationSnapshot& target = _snapshots[_writeIndex];
+        sph.setInstanceSink({ target._positions, target._colors });
+        {
+            const TraceScope trace("step", "simulation");
+            sph.step();
+        }
+        ++_stepCount;
+
+        // Average the rate over half a second so the readout stays steady.
+        const auto now = Clock::now();
+        ++rateSteps;
+        if (now - rateStart >= std::chrono::milliseconds(500)) {
+            _stepsPerSecond = static_cast<float>(rateSteps)
+                / std::chrono::duration<float>(now - rateStart).count();
+            rateStart = now;
+            rateSteps = 0;
+        }
+
+        {
+            const TraceScope trace("publish", "simulation");
+            publish();
+        }
+
+        if (const float target = _targetStepsPerSecond; target > 0.0f) {
+            // Stay on a fixed schedule, but start over instead of bursting to catch up after
+            // falling behind.
+            nextStep += std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<float>(1.0f / target));
+            if (nextStep < now)
+                nextStep = now;
+            std::this_thread::sleep_until(nextStep);
+        } else {
+            nextStep = now;
+        }
+    }
+}
+
+void Simulation::copyParticles()
+{
+    const ParticleView particles = SPH::getInstance().particles();
+    SimulationSnapshot& snapshot = _snapshots[_writeIndex];
+
+    for (size_t i = 0; i < particles.size(); ++i) {
+        const Vec3<float> position = particles.position(i);
+        const Vec3<float> color = Particle::color(particles.velocity(i));
+        for (size_t axis = 0; axis < 3; ++axis) {
+            snapshot._positions[i * 3 + axis] = position[axis];
+            snapshot._colors[i * 3 + axis] = color[axis];
+        }
+    }
+}
+
+void Simulation::publish()
+{
+    const SPH& sph = SPH::getInstance();
+    SimulationSnapshot& snapshot = _snapshots[_writeIndex];
+
+    snapshot._particleCount = sph.particles().size();
+    snapshot._step = _stepCount;
+    snapshot._stepTime = sph.stepTime();
+    snapshot._substeps = sph.substepCount();
+    snapshot._timestep = sph.timestep();
+    snapshot._pressureIterations = sph.pressureIterations();
+    snapshot._densityError = sph.densityError();
+    snapshot._simdLevel = sph.simdLevel();
+    snapshot._stepsPerSecond = _stepsPerSecond;
+    snapshot._idleTimes = sph.idleTimes();
+    snapshot._phaseTimes = sph.phaseTimes();
+
+    _writeIndex = _ready.exchange(_writeIndex | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
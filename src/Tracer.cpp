@@ -0,0 +1,199 @@
+#include "Tracer.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace {
+thread_local std::string threadName;
+
+int64_t nanoseconds(const Tracer::Clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+} // namespace
+
+Tracer& Tracer::getInstance()
+{
+    static Tracer instance;
+    return instance;
+}
+
+Tracer::~Tracer()
+{
+    stop();
+}
+
+bool Tracer::start(const std::string& path)
+{
+    if (_enabled)
+        return true;
+
+    _file.open(path, std::ios::trunc);
+    if (!_file)
+        return false;
+    _file << "{\"traceEvents\":[";
+    _file << std::fixed << std::setprecision(3);
+    _firstEvent = true;
+
+    // Events left over from an earlier trace are skipped, and every thread is named again.
+    {
+        const std::lock_guard lock(_buffersMutex);
+        for (const std::shared_ptr<Buffer>& buffer : _buffers) {
+            buffer->_tail.store(buffer->_head.load(std::memory_order_acquire));
+            buffer->_dropped = 0;
+            buffer->_named = false;
+        }
+    }
+
+    _startTime = Clock::now();
+    _enabled.store(true, std::memory_order_release);
+    _drainThread = std::thread(&Tracer::drainLoop, this);
+    return true;
+}
+
+void Tracer::stop()
+{
+    if (!_enabled)
+        return;
+
+    _enabled = false;
+    _drainThread.join();
+    drain();
+
+    uint64_t dropped = 0;
+    {
+        const std::lock_guard lock(_buffersMutex);
+        for (const std::shared_ptr<Buffer>& buffer : _buffers)
+            dropped += buffer->_dropped;
+    }
+    _file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":\"" << dropped
+          << "\"}}\n";
+    _file.close();
+}
+
+bool Tracer::enabled() const
+{
+    return _enabled.load(std::memory_order_relaxed);
+}
+
+void Tracer::record(const char* name, const char* category, const Clock::time_point begin,
+    const Clock::time_point end)
+{
+    if (!enabled())
+        return;
+
+    Buffer& buffer = threadBuffer();
+    const uint64_t head = buffer._head.load(std::memory_order_relaxed);
+    if (head - buffer._tail.load(std::memory_order_acquire) >= Buffer::CAPACITY) {
+        buffer._dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer._events[head % Buffer::CAPACITY] = { name, category, nanoseconds(begin),
+        nanoseconds(end) };
+    buffer._head.store(head + 1, std::memory_order_release);
+}
+
+void Tracer::setThreadName(std::string name)
+{
+    threadName = std::move(name);
+
+    // Register the buffer while the thread starts up, so its first event does not allocate in the
+    // middle of whatever it times, such as a step that the allocation audit watches.
+    getInstance().threadBuffer();
+}
+
+Tracer::Buffer& Tracer::threadBuffer()
+{
+    // The tracer and the thread share the buffer, so whichever of them finishes last frees it.
+    struct Registration {
+        std::shared_ptr<Buffer> _buffer;
+
+        ~Registration()
+        {
+            if (_buffer)
+                _buffer->_retired.store(true, std::memory_order_release);
+        }
+    };
+    thread_local Registration registration;
+
+    if (!registration._buffer) {
+        auto buffer = std::make_shared<Buffer>();
+        const std::lock_guard lock(_buffersMutex);
+        buffer->_threadId = _nextThreadId++;
+        buffer->_threadName = threadName.empty()
+            ? "Thread " + std::to_string(buffer->_threadId)
+            : threadName;
+        _buffers.push_back(buffer);
+        registration._buffer = std::move(buffer);
+    }
+    return *registration._buffer;
+}
+
+void Tracer::drainLoop()
+{
+    while (_enabled) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+void Tracer::drain()
+{
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    {
+        const std::lock_guard lock(_buffersMutex);
+        buffers = _buffers;
+    }
+
+    const int64_t start = nanoseconds(_startTime);
+    auto separate = [this] {
+        _file << (_firstEvent ? "\n" : ",\n");
+        _firstEvent = false;
+    };
+
+    for (const std::shared_ptr<Buffer>& buffer : buffers) {
+        // Check for retirement first, so every event of an exited thread is written before its
+        // buffer is dropped.
+        const bool retired = buffer->_retired.load(std::memory_order_acquire);
+        const uint64_t head = buffer->_head.load(std::memory_order_acquire);
+        uint64_t tail = buffer->_tail.load(std::memory_order_relaxed);
+        if (tail != head && !buffer->_named) {
+            separate();
+            _file << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer->_threadId
+                  << R"(,"args":{"name":")" << buffer->_threadName << "\"}}";
+            buffer->_named = true;
+        }
+
+        for (; tail != head; ++tail) {
+            const Event& event = buffer->_events[tail % Buffer::CAPACITY];
+            if (event._end < start)
+                continue;
+            const int64_t begin = std::max(event._begin, start);
+            separate();
+            _file << R"({"name":")" << event._name << R"(","cat":")" << event._category
+                  << R"(","ph":"X","pid":1,"tid":)" << buffer->_threadId
+                  << ",\"ts\":" << static_cast<double>(begin - start) / 1000.0
+                  << ",\"dur\":" << static_cast<double>(event._end - begin) / 1000.0 << '}';
+        }
+        buffer->_tail.store(head, std::memory_order_release);
+
+        if (retired) {
+            const std::lock_guard lock(_buffersMutex);
+            std::erase(_buffers, buffer);
+        }
+    }
+}
+
+TraceScope::TraceScope(const char* name, const char* category)
+    : _name(name)
+    , _category(category)
+    , _active(Tracer::getInstance().enabled())
+{
+    if (_active)
+        _begin = Tracer::Clock::now();
+}
+
+TraceScope::~TraceScope()
+{
+    if (_active)
+        Tracer::getInstance().record(_name, _category, _begin, Tracer::Clock::now());
+}
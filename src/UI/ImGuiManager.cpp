@@ -5,10 +5,14 @@
 #include "../../include/UI/ImGuiManager.h"
 #include "Math/SPH.h"
 #include "Rules.h"
+#include "Simulation.h"
+#include "UI/ProfilerPanel.h"
+#include "UI/Renderer.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
 
 ImGuiManager& ImGuiManager::getInstance()
 {
@@ -54,10 +58,14 @@ void ImGuiManager::beginFrame()
 
 void ImGuiManager::configureUI()
 {
-    SPH& sph = SPH::getInstance();
-    SPHConfig config = sph.config();
+    Simulation& simulation = Simulation::getInstance();
+    SPHConfig config = simulation.config();
     bool configChanged = false;
 
+    // Drawn first so the profiler keeps recording while the config window is collapsed.
+    ProfilerPanel& profiler = ProfilerPanel::getInstance();
+    profiler.draw(simulation.snapshot());
+
     if (!ImGui::Begin("SPH Config")) {
         ImGui::End();
         return;
@@ -66,9 +74,32 @@ void ImGuiManager::configureUI()
     ImGui::SeparatorText("SPH Config");
     configChanged |= ImGui::SliderFloat("Gravity", &config.gravity, -50.0f, 0.0f, "%.2f");
     configChanged
-        |= ImGui::SliderFloat("Target Density", &config.targetDensity, 10.0f, 2000.0f, "%.1f");
-    configChanged
-        |= ImGui::SliderFloat("Pressure Mult", &config.pressureMultiplier, 0.0f, 2000.0f, "%.1f");
+        |= ImGui::SliderFloat("Target Density", &config.targetDensity, 10.0f, 10000.0f, "%.1f");
+    int smoothingKernel = static_cast<int>(config.smoothingKernel);
+    if (ImGui::Combo("Smoothing Kernel", &smoothingKernel,
+            "Spiky\0Poly6\0Cubic Spline\0Wendland C2\0")) {
+        config.smoothingKernel = static_cast<SmoothingKernel>(smoothingKernel);
+        configChanged = true;
+    }
+    int pressureSolver = static_cast<int>(config.pressureSolver);
+    if (ImGui::Combo("Pressure Solver", &pressureSolver, "State Equation\0Implicit\0Position Based\0")) {
+        config.pressureSolver = static_cast<PressureSolver>(pressureSolver);
+        configChanged = true;
+    }
+    if (config.pressureSolver == PressureSolver::Implicit) {
+        configChanged |= ImGui::SliderFloat(
+            "Density Tolerance", &config.densityTolerance, 0.001f, 0.1f, "%.3f");
+        configChanged
+            |= ImGui::SliderInt("Max Iterations", &config.maxPressureIterations, 2, 200);
+    } else if (config.pressureSolver == PressureSolver::PositionBased) {
+        configChanged |= ImGui::SliderInt(
+            "Constraint Iterations", &config.constraintIterations, 1, 20);
+        configChanged |= ImGui::SliderFloat(
+            "Tensile Correction", &config.tensileCorrection, 0.0f, 0.05f, "%.3f");
+    } else {
+        configChanged |= ImGui::SliderFloat(
+            "Pressure Mult", &config.pressureMultiplier, 0.0f, 2000.0f, "%.1f");
+    }
     configChanged |= ImGui::SliderFloat(
         "Near Pressure Mult", &config.nearPressureMultiplier, 0.0f, 50.0f, "%.2f");
     configChanged
@@ -77,11 +108,81 @@ void ImGuiManager::configureUI()
         |= ImGui::SliderFloat("Collision Damping", &config.collisionDamping, 0.0f, 1.0f, "%.2f");
     configChanged |= ImGui::SliderFloat3("Bounds", &config.bounds[0], 0.1f, 5.0f, "%.2f");
 
+    ImGui::SeparatorText("Performance");
+    int neighborGrid = static_cast<int>(config.neighborGrid);
+    if (ImGui::Combo("Neighbor Grid", &neighborGrid, "Hashed\0Dense\0")) {
+        config.neighborGrid = static_cast<NeighborGrid>(neighborGrid);
+        configChanged = true;
+    }
+    int particleOrder = static_cast<int>(config.particleOrder);
+    if (ImGui::Combo("Particle Order", &particleOrder, "Cell Key\0Morton\0Hilbert\0")) {
+        config.particleOrder = static_cast<ParticleOrder>(particleOrder);
+        configChanged = true;
+    }
+    configChanged |= ImGui::Checkbox("Neighbor Lists", &config.neighborLists);
+    if (config.neighborLists) {
+        configChanged
+            |= ImGui::SliderFloat("Neighbor Skin", &config.neighborSkin, 0.0f, 0.2f, "%.3f");
+    }
+    configChanged |= ImGui::Checkbox("Symmetric Pairs", &config.symmetricPairs);
+    configChanged |= ImGui::Checkbox("Fused Forces", &config.fusedForces);
+    int simdLevel = static_cast<int>(config.simdLevel);
+    if (ImGui::Combo("Neighbor Kernels", &simdLevel, "Scalar\0SSE4.1\0AVX2\0AVX-512\0")) {
+        config.simdLevel = static_cast<SimdLevel>(simdLevel);
+        configChanged = true;
+    }
+    configChanged |= ImGui::Checkbox("Adaptive Timestep", &config.adaptiveTimestep);
+    if (config.adaptiveTimestep) {
+        configChanged
+            |= ImGui::SliderFloat("Courant Number", &config.courantNumber, 0.05f, 1.0f, "%.2f");
+        configChanged
+            |= ImGui::SliderFloat("Force Number", &config.forceNumber, 0.05f, 1.0f, "%.2f");
+        configChanged |= ImGui::SliderInt("Max Substeps", &config.maxSubsteps, 1, 64);
+    }
+    float targetStepsPerSecond = simulation.targetStepsPerSecond();
+    if (ImGui::SliderFloat("Target Steps/s", &targetStepsPerSecond, 0.0f, 480.0f,
+            targetStepsPerSecond > 0.0f ? "%.0f" : "Unlimited")) {
+        simulation.setTargetStepsPerSecond(targetStepsPerSecond);
+    }
+
     if (configChanged) {
-        sph.setConfig(config);
+        simulation.setConfig(config);
+    }
+
+    ImGui::SeparatorText("Rendering");
+    Renderer& renderer = Renderer::getInstance();
+    int particleStyle = static_cast<int>(renderer.particleStyle());
+    if (ImGui::Combo("Particle Style", &particleStyle, "Mesh\0Impostor\0")) {
+        renderer.setParticleStyle(static_cast<ParticleStyle>(particleStyle));
     }
 
+    const SimulationSnapshot& snapshot = simulation.snapshot();
     ImGui::Separator();
+    ImGui::Text("Particles: %zu", snapshot._particleCount);
+    ImGui::Text("Step: %.2f ms (%.1f steps/s)", snapshot._stepTime, snapshot._stepsPerSecond);
+    ImGui::Text("Substeps: %d (dt %.2f ms)", snapshot._substeps, snapshot._timestep * 1000.0f);
+    ImGui::Text("Neighbor Kernels: %s", simdLevelName(snapshot._simdLevel));
+    if (snapshot._pressureIterations > 0) {
+        ImGui::Text("Pressure Iterations: %d (error %.2f%%)", snapshot._pressureIterations,
+            snapshot._densityError * 100.0f);
+    }
+    // At the cap the particles are left compressed, usually because the target density asks for
+    // more volume than the bounds hold.
+    if (config.pressureSolver == PressureSolver::Implicit
+        && snapshot._pressureIterations >= config.maxPressureIterations) {
+        ImGui::TextColored(
+            ImVec4(1.0f, 0.6f, 0.2f, 1.0f), "Pressure solve stopped at the iteration cap");
+    }
+    if (ImGui::TreeNode("Thread Idle")) {
+        const std::vector<float>& idleTimes = snapshot._idleTimes;
+        const float stepTime = std::max(snapshot._stepTime, 1e-6f);
+        for (size_t thread = 0; thread < idleTimes.size(); ++thread) {
+            ImGui::Text("Thread %zu: %.2f ms (%.0f%%)", thread, idleTimes[thread],
+                100.0f * idleTimes[thread] / stepTime);
+        }
+        ImGui::TreePop();
+    }
+    ImGui::Checkbox("Profiler", &profiler.visible());
     const ImGuiIO& io = ImGui::GetIO();
     ImGui::Text(
         "Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
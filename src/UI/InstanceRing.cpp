@@ -0,0 +1,124 @@
+#include "UI/InstanceRing.h"
+#include <GLFW/glfw3.h>
+#include <cstring>
+#include <glad/glad.h>
+
+namespace {
+// ARB_buffer_storage is not part of the OpenGL 3.3 loader, so its entry point and flags are
+// declared here.
+constexpr GLbitfield MAP_PERSISTENT_BIT = 0x0040;
+constexpr GLbitfield MAP_COHERENT_BIT = 0x0080;
+using BufferStorageProc = void(APIENTRYP)(GLenum, GLsizeiptr, const void*, GLbitfield);
+
+bool hasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const auto* extension
+            = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+} // namespace
+
+InstanceRing::~InstanceRing()
+{
+    for (GLsync& fence : _fences) {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    if (_buffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &_buffer);
+    }
+}
+
+bool InstanceRing::init(const size_t capacity)
+{
+    if (!hasExtension("GL_ARB_buffer_storage"))
+        return false;
+
+    const auto bufferStorage
+        = reinterpret_cast<BufferStorageProc>(glfwGetProcAddress("glBufferStorage"));
+    if (!bufferStorage || capacity == 0)
+        return false;
+
+    // Coherent mapping makes CPU writes visible to the GPU without explicit flushes.
+    const GLbitfield flags = GL_MAP_WRITE_BIT | MAP_PERSISTENT_BIT | MAP_COHERENT_BIT;
+    const auto size = static_cast<GLsizeiptr>(SLOT_COUNT * capacity * 6 * sizeof(float));
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    bufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    _mapped = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (!_mapped) {
+        glDeleteBuffers(1, &_buffer);
+        _buffer = 0;
+        return false;
+    }
+    _capacity = capacity;
+    return true;
+}
+
+bool InstanceRing::ready() const
+{
+    return _mapped != nullptr;
+}
+
+float* InstanceRing::positions(const uint32_t slot) const
+{
+    return _mapped + positionOffset(slot) / sizeof(float);
+}
+
+float* InstanceRing::colors(const uint32_t slot) const
+{
+    return _mapped + colorOffset(slot) / sizeof(float);
+}
+
+size_t InstanceRing::positionOffset(const uint32_t slot) const
+{
+    return slot * _capacity * 6 * sizeof(float);
+}
+
+size_t InstanceRing::colorOffset(const uint32_t slot) const
+{
+    return positionOffset(slot) + _capacity * 3 * sizeof(float);
+}
+
+uint32_t InstanceRing::buffer() const
+{
+    return _buffer;
+}
+
+size_t InstanceRing::capacity() const
+{
+    return _capacity;
+}
+
+void InstanceRing::fence(const uint32_t slot)
+{
+    if (_fences[slot])
+        glDeleteSync(_fences[slot]);
+    _fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void InstanceRing::wait(const uint32_t slot)
+{
+    GLsync& fence = _fences[slot];
+    if (!fence)
+        return;
+
+    // Flush on the first wait so the fence is guaranteed to reach the GPU.
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fence, flags, 1'000'000'000) == GL_TIMEOUT_EXPIRED) {
+        flags = 0;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
@@ -132,11 +132,43 @@ void Mesh::draw() const
     glDrawArrays(toGLPrimitive(_primitive), 0, _vertexCount);
 }
 
+void Mesh::setInstanceAttribute(
+    const uint32_t location, const uint32_t buffer, const size_t offset) const
+{
+    if (_vao == 0)
+        return;
+
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+        reinterpret_cast<const void*>(offset));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, 1);
+    glBindVertexArray(0);
+}
+
+void Mesh::drawInstanced(const int instanceCount) const
+{
+    if (_vao == 0 || _vertexCount == 0 || instanceCount == 0)
+        return;
+
+    glBindVertexArray(_vao);
+    glDrawArraysInstanced(toGLPrimitive(_primitive), 0, _vertexCount, instanceCount);
+}
+
 Mesh MeshFactory::createSphere(const float radius, const int rings, const int segments)
 {
     return Mesh(buildSphereVertices(radius, rings, segments), Primitive::Triangles);
 }
 
+Mesh MeshFactory::createQuad(const float halfSize)
+{
+    const float h = halfSize;
+    const std::vector vertices = { -h, -h, 0.0f, h, -h, 0.0f, h, h, 0.0f, -h, -h, 0.0f, h, h, 0.0f,
+        -h, h, 0.0f };
+    return Mesh(vertices, Primitive::Triangles);
+}
+
 Mesh MeshFactory::createBox(const Vec3<float>& halfSize)
 {
     const float hx = halfSize[0];
@@ -0,0 +1,62 @@
+#include "UI/ParticleRenderer.h"
+#include "glad/glad.h"
+#include <algorithm>
+
+float ParticleRenderer::_radius = 0.02f;
+Mesh ParticleRenderer::_mesh;
+Mesh ParticleRenderer::_impostorMesh;
+uint32_t ParticleRenderer::_instanceBuffer = 0;
+size_t ParticleRenderer::_instanceCapacity = 0;
+ParticleRenderer::InstanceBinding ParticleRenderer::_meshBinding;
+ParticleRenderer::InstanceBinding ParticleRenderer::_impostorBinding;
+
+void ParticleRenderer::init()
+{
+    _mesh = MeshFactory::createSphere(_radius);
+    _impostorMesh = MeshFactory::createQuad(1.0f);
+    glGenBuffers(1, &_instanceBuffer);
+    _instanceCapacity = 0;
+    _meshBinding = {};
+    _impostorBinding = {};
+}
+
+float ParticleRenderer::radius()
+{
+    return _radius;
+}
+
+void ParticleRenderer::draw(
+    const float* positions, const float* colors, const size_t count, const ParticleStyle style)
+{
+    if (count == 0)
+        return;
+
+    // Orphan last frame's storage so the upload does not wait for its draw to finish.
+    _instanceCapacity = std::max(_instanceCapacity, count);
+    const auto size = static_cast<GLsizeiptr>(count * 3 * sizeof(float));
+    const auto capacity = static_cast<GLsizeiptr>(_instanceCapacity * 3 * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, 2 * capacity, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, positions);
+    glBufferSubData(GL_ARRAY_BUFFER, capacity, size, colors);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    draw(_instanceBuffer, 0, static_cast<size_t>(capacity), count, style);
+}
+
+void ParticleRenderer::draw(const uint32_t buffer, const size_t positionOffset,
+    const size_t colorOffset, const size_t count, const ParticleStyle style)
+{
+    if (count == 0)
+        return;
+
+    const bool impostor = style == ParticleStyle::Impostor;
+    const Mesh& mesh = impostor ? _impostorMesh : _mesh;
+    InstanceBinding& bound = impostor ? _impostorBinding : _meshBinding;
+    if (const InstanceBinding binding { buffer, positionOffset, colorOffset }; binding != bound) {
+        mesh.setInstanceAttribute(1, buffer, positionOffset);
+        mesh.setInstanceAttribute(2, buffer, colorOffset);
+        bound = binding;
+    }
+    mesh.drawInstanced(static_cast<int>(count));
+}
@@ -0,0 +1,201 @@
+#include "UI/ProfilerPanel.h"
+#include "Simulation.h"
+#include "Tracer.h"
+#include "imgui.h"
+#include <algorithm>
+#include <cstdio>
+
+ProfilerPanel& ProfilerPanel::getInstance()
+{
+    static ProfilerPanel instance;
+    return instance;
+}
+
+bool& ProfilerPanel::visible()
+{
+    return _visible;
+}
+
+void ProfilerPanel::record(const SimulationSnapshot& snapshot)
+{
+    // Workers leave every phase together at a barrier, so a phase's wall time is the longest
+    // work plus wait of any thread.
+    std::array<float, PHASE_COUNT> wallTimes {};
+    for (const PhaseTimes& times : snapshot._phaseTimes) {
+        for (size_t phase = 0; phase < PHASE_COUNT; ++phase) {
+            wallTimes[phase] = std::max(wallTimes[phase], times._work[phase] + times._wait[phase]);
+        }
+    }
+    wallTimes[static_cast<size_t>(SPHPhase::Step)] = snapshot._stepTime;
+
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+        _history[phase][_historyNext] = wallTimes[phase];
+    _historyNext = (_historyNext + 1) % HISTORY_SIZE;
+    _historyCount = std::min(_historyCount + 1, HISTORY_SIZE);
+}
+
+float ProfilerPanel::percentile(const History& history, const float fraction)
+{
+    if (_historyCount == 0)
+        return 0.0f;
+
+    _sorted.assign(history.begin(), history.begin() + static_cast<std::ptrdiff_t>(_historyCount));
+    const auto rank = static_cast<std::ptrdiff_t>(
+        fraction * static_cast<float>(_historyCount - 1) + 0.5f);
+    std::ranges::nth_element(_sorted, _sorted.begin() + rank);
+    return _sorted[static_cast<size_t>(rank)];
+}
+
+void ProfilerPanel::drawTraceControls()
+{
+    Tracer& tracer = Tracer::getInstance();
+    if (tracer.enabled()) {
+        if (ImGui::Button("Stop Trace"))
+            tracer.stop();
+        ImGui::SameLine();
+        ImGui::Text("Recording %s", TRACE_PATH);
+    } else {
+        if (ImGui::Button("Start Trace"))
+            _traceFailed = !tracer.start(TRACE_PATH);
+        if (_traceFailed) {
+            ImGui::SameLine();
+            ImGui::Text("Could not open %s", TRACE_PATH);
+        }
+    }
+}
+
+void ProfilerPanel::drawCounters(const SimulationSnapshot& snapshot)
+{
+    Simulation& simulation = Simulation::getInstance();
+    SPHConfig config = simulation.config();
+    if (ImGui::Checkbox("Hardware Counters", &config.hardwareCounters))
+        simulation.setConfig(config);
+    if (!config.hardwareCounters)
+        return;
+
+    const std::vector<PhaseTimes>& threads = snapshot._phaseTimes;
+    if (threads.empty() || !std::ranges::all_of(threads, &PhaseTimes::_counted)) {
+        ImGui::TextUnformatted("Counters unavailable (needs Linux perf_event_open access)");
+        return;
+    }
+
+    constexpr ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV;
+    if (!ImGui::BeginTable("Counters", 4, flags))
+        return;
+    ImGui::TableSetupColumn("Phase");
+    ImGui::TableSetupColumn("IPC");
+    ImGui::TableSetupColumn("LLC miss/particle");
+    ImGui::TableSetupColumn("Branch miss/particle");
+    ImGui::TableHeadersRow();
+
+    // Summed over every worker, so the ratios describe the phase as a whole.
+    const auto particles = static_cast<double>(std::max<size_t>(snapshot._particleCount, 1));
+    for (size_t phase = 1; phase < PHASE_COUNT; ++phase) {
+        CounterValues counters;
+        for (const PhaseTimes& times : threads)
+            counters += times._counters[phase];
+        if (counters._cycles == 0)
+            continue;
+
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(phaseName(static_cast<SPHPhase>(phase)));
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2f",
+            static_cast<double>(counters._instructions) / static_cast<double>(counters._cycles));
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", static_cast<double>(counters._cacheMisses) / particles);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", static_cast<double>(counters._branchMisses) / particles);
+    }
+    ImGui::EndTable();
+}
+
+void ProfilerPanel::draw(const SimulationSnapshot& snapshot)
+{
+    if (snapshot._step != _lastStep && !snapshot._phaseTimes.empty()) {
+        record(snapshot);
+        _lastStep = snapshot._step;
+    }
+
+    if (!_visible)
+        return;
+    if (!ImGui::Begin("Profiler", &_visible)) {
+        ImGui::End();
+        return;
+    }
+
+    // Until the ring is full, the oldest sample is at index 0.
+    const int count = static_cast<int>(_historyCount);
+    const int offset = _historyCount == HISTORY_SIZE ? static_cast<int>(_historyNext) : 0;
+    const size_t latest = (_historyNext + HISTORY_SIZE - 1) % HISTORY_SIZE;
+
+    drawTraceControls();
+    ImGui::Text("Last %zu steps", _historyCount);
+    constexpr ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV;
+    if (ImGui::BeginTable("Phases", 5, flags)) {
+        ImGui::TableSetupColumn("Phase");
+        ImGui::TableSetupColumn("Last ms");
+        ImGui::TableSetupColumn("p50 ms");
+        ImGui::TableSetupColumn("p99 ms");
+        ImGui::TableSetupColumn("History", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableHeadersRow();
+
+        // Phases in step order, then the whole step. Phases that never ran (the offsets with one
+        // thread, lists while they are off) are left out.
+        for (size_t row = 1; row <= PHASE_COUNT; ++row) {
+            const size_t phase = row % PHASE_COUNT;
+            const History& history = _history[phase];
+            const auto historyEnd = history.begin() + count;
+            if (std::all_of(history.begin(), historyEnd, [](const float ms) { return ms == 0.0f; }))
+                continue;
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(phaseName(static_cast<SPHPhase>(phase)));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", history[latest]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", percentile(history, 0.5f));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", percentile(history, 0.99f));
+            ImGui::TableNextColumn();
+            ImGui::PushID(static_cast<int>(phase));
+            ImGui::SetNextItemWidth(-1.0f);
+            ImGui::PlotLines("##History", history.data(), count, offset, nullptr, 0.0f);
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+
+    // Work and barrier wait of the latest step per thread; long waits on some threads mean the
+    // phase before the barrier is unevenly split.
+    const std::vector<PhaseTimes>& threads = snapshot._phaseTimes;
+    if (!threads.empty() && ImGui::TreeNode("Per Thread (work / wait ms)")) {
+        const int columns = static_cast<int>(threads.size()) + 1;
+        if (ImGui::BeginTable("Threads", columns, flags | ImGuiTableFlags_ScrollX)) {
+            ImGui::TableSetupColumn("Phase");
+            for (size_t thread = 0; thread < threads.size(); ++thread) {
+                char label[16];
+                std::snprintf(label, sizeof(label), "Thread %zu", thread);
+                ImGui::TableSetupColumn(label);
+            }
+            ImGui::TableHeadersRow();
+
+            for (size_t phase = 1; phase < PHASE_COUNT; ++phase) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(phaseName(static_cast<SPHPhase>(phase)));
+                for (const PhaseTimes& times : threads) {
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%.2f / %.2f", times._work[phase], times._wait[phase]);
+                }
+            }
+            ImGui::EndTable();
+        }
+        ImGui::TreePop();
+    }
+
+    drawCounters(snapshot);
+    ImGui::End();
+}
@@ -2,12 +2,36 @@
 #include "../../include/Math/SPH.h"
 #include "../../include/UI/Camera.h"
 #include "../../include/UI/Mesh.h"
+#include "../../include/UI/ParticleRenderer.h"
 #include "Rules.h"
+#include "Simulation.h"
 #include "UI/Window.h"
-#include <Particle.h>
+#include <array>
 #include <cmath>
 #include <glad/glad.h>
 
+namespace {
+uint32_t createProgram(const char* vertexSrc, const char* fragmentSrc)
+{
+    const uint32_t vs = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vs, 1, &vertexSrc, nullptr);
+    glCompileShader(vs);
+
+    const uint32_t fs = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fs, 1, &fragmentSrc, nullptr);
+    glCompileShader(fs);
+
+    const uint32_t program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return program;
+}
+} // namespace
+
 Renderer& Renderer::getInstance()
 {
     static Renderer instance;
@@ -19,48 +43,101 @@ bool Renderer::init()
     const auto vertexSrc = R"(
         #version 330 core
         layout (location = 0) in vec3 aPos;
+        layout (location = 1) in vec3 aOffset;
+        layout (location = 2) in vec3 aColor;
 
-        uniform vec3 uOffset;
         uniform mat4 uProjection;
         uniform mat4 uView;
 
+        out vec3 vColor;
+
         void main()
         {
-            gl_Position = uProjection * uView * vec4(aPos + uOffset, 1.0);
+            gl_Position = uProjection * uView * vec4(aPos + aOffset, 1.0);
+            vColor = aColor;
         }
     )";
 
     const auto fragmentSrc = R"(
         #version 330 core
+        in vec3 vColor;
         out vec4 FragColor;
 
-        uniform vec3 uColor;
+        void main()
+        {
+            FragColor = vec4(vColor, 1.0);
+        }
+    )";
+
+    _shaderProgram = createProgram(vertexSrc, fragmentSrc);
+
+    // Impostors: each particle is a quad facing the camera, sized to cover the sphere's
+    // silhouette. The fragment shader intersects the view ray with the sphere and writes the hit
+    // point's depth, so spheres overlap correctly.
+    const auto impostorVertexSrc = R"(
+        #version 330 core
+        layout (location = 0) in vec3 aPos;
+        layout (location = 1) in vec3 aOffset;
+        layout (location = 2) in vec3 aColor;
+
+        uniform mat4 uProjection;
+        uniform mat4 uView;
+        uniform float uRadius;
+
+        out vec3 vViewPosition;
+        out vec3 vCenter;
+        out vec3 vColor;
 
         void main()
         {
-            FragColor = vec4(uColor, 1.0);
+            vec3 center = (uView * vec4(aOffset, 1.0)).xyz;
+            vec3 forward = normalize(center);
+            vec3 helper = abs(forward.y) > 0.99 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+            vec3 right = normalize(cross(forward, helper));
+            vec3 up = cross(right, forward);
+
+            // A quad through the center, facing the camera, must be r * d / sqrt(d^2 - r^2) wide
+            // to reach the edges of the sphere's silhouette cone.
+            float distance2 = dot(center, center);
+            float halfSize = uRadius * inversesqrt(max(1.0 - uRadius * uRadius / distance2, 1e-4));
+
+            vViewPosition = center + (right * aPos.x + up * aPos.y) * halfSize;
+            vCenter = center;
+            vColor = aColor;
+            gl_Position = uProjection * vec4(vViewPosition, 1.0);
         }
     )";
 
-    const uint32_t vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs, 1, &vertexSrc, nullptr);
-    glCompileShader(vs);
+    const auto impostorFragmentSrc = R"(
+        #version 330 core
+        in vec3 vViewPosition;
+        in vec3 vCenter;
+        in vec3 vColor;
+        out vec4 FragColor;
 
-    const uint32_t fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs, 1, &fragmentSrc, nullptr);
-    glCompileShader(fs);
+        uniform mat4 uProjection;
+        uniform float uRadius;
 
-    _shaderProgram = glCreateProgram();
-    glAttachShader(_shaderProgram, vs);
-    glAttachShader(_shaderProgram, fs);
-    glLinkProgram(_shaderProgram);
+        void main()
+        {
+            vec3 ray = normalize(vViewPosition);
+            float b = dot(ray, vCenter);
+            float h = b * b - dot(vCenter, vCenter) + uRadius * uRadius;
+            if (h < 0.0)
+                discard;
+
+            vec3 hit = ray * (b - sqrt(h));
+            vec4 clip = uProjection * vec4(hit, 1.0);
+            gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+            FragColor = vec4(vColor, 1.0);
+        }
+    )";
 
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+    _impostorShaderProgram = createProgram(impostorVertexSrc, impostorFragmentSrc);
 
     glEnable(GL_DEPTH_TEST);
 
-    Particle::init(_shaderProgram);
+    ParticleRenderer::init();
 
     const auto boxVertexSrc = R"(
         #version 330 core
@@ -85,21 +162,7 @@ bool Renderer::init()
         }
     )";
 
-    const uint32_t boxVs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(boxVs, 1, &boxVertexSrc, nullptr);
-    glCompileShader(boxVs);
-
-    const uint32_t boxFs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(boxFs, 1, &boxFragmentSrc, nullptr);
-    glCompileShader(boxFs);
-
-    _boxShaderProgram = glCreateProgram();
-    glAttachShader(_boxShaderProgram, boxVs);
-    glAttachShader(_boxShaderProgram, boxFs);
-    glLinkProgram(_boxShaderProgram);
-
-    glDeleteShader(boxVs);
-    glDeleteShader(boxFs);
+    _boxShaderProgram = createProgram(boxVertexSrc, boxFragmentSrc);
 
     _boxMesh = MeshFactory::createBox(SPH::getInstance().config().bounds);
 
@@ -107,10 +170,28 @@ bool Renderer::init()
     const Window& window = Window::getInstance();
     _aspect = static_cast<float>(window._width) / static_cast<float>(window._height);
 
-    // Initialize SPH with particles
+    // Initialize SPH with particles. Substepping keeps the scene stable while sliders are dragged,
+    // and the target density is what the spawned particles rest at, which the box can hold.
     SPH& sph = SPH::getInstance();
     const auto initialParticles = spawnParticlesInBox(10000, 2.0f, 0.05f, 0.5f);
-    sph.init({}, initialParticles);
+    SPHConfig config;
+    config.adaptiveTimestep = true;
+    config.targetDensity = restDensity(config, initialParticles);
+    sph.init(config, initialParticles);
+
+    // Let the simulation write straight into a persistently mapped ring; without
+    // ARB_buffer_storage, snapshots stay in memory and are uploaded every frame instead.
+    if (_instanceRing.init(sph.particles().size())) {
+        std::array<float*, InstanceRing::SLOT_COUNT> positions {};
+        std::array<float*, InstanceRing::SLOT_COUNT> colors {};
+        for (uint32_t slot = 0; slot < InstanceRing::SLOT_COUNT; ++slot) {
+            positions[slot] = _instanceRing.positions(slot);
+            colors[slot] = _instanceRing.colors(slot);
+        }
+        Simulation& simulation = Simulation::getInstance();
+        simulation.setSnapshotStorage(positions, colors, _instanceRing.capacity());
+        simulation.setReleaseHandler([this](const uint32_t slot) { _instanceRing.wait(slot); });
+    }
 
     return true;
 }
@@ -119,26 +200,34 @@ void Renderer::draw()
 {
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glUseProgram(_shaderProgram);
+    const uint32_t particleProgram
+        = _particleStyle == ParticleStyle::Impostor ? _impostorShaderProgram : _shaderProgram;
+    glUseProgram(particleProgram);
 
     // Update view for Camera
     const auto projection = _camera->getProjectionMatrix(_aspect);
     const auto view = _camera->getViewMatrix();
-    const int projLoc = glGetUniformLocation(_shaderProgram, "uProjection");
-    const int viewLoc = glGetUniformLocation(_shaderProgram, "uView");
+    const int projLoc = glGetUniformLocation(particleProgram, "uProjection");
+    const int viewLoc = glGetUniformLocation(particleProgram, "uView");
     glUniformMatrix4fv(projLoc, 1, GL_FALSE, projection);
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, view);
-
-    // Draw particles
-    SPH& sph = SPH::getInstance();
-    sph.step();
-    const auto& particles = sph.particles();
-    for (const auto& particle : particles) {
-        particle.draw();
+    glUniform1f(glGetUniformLocation(particleProgram, "uRadius"), ParticleRenderer::radius());
+
+    // Draw particles from the latest snapshot; the simulation steps on its own thread.
+    Simulation& simulation = Simulation::getInstance();
+    const SimulationSnapshot& snapshot = simulation.acquireSnapshot();
+    const uint32_t slot = snapshot._slot;
+    if (_instanceRing.ready() && snapshot._positions == _instanceRing.positions(slot)) {
+        ParticleRenderer::draw(_instanceRing.buffer(), _instanceRing.positionOffset(slot),
+            _instanceRing.colorOffset(slot), snapshot._particleCount, _particleStyle);
+        _instanceRing.fence(slot);
+    } else {
+        ParticleRenderer::draw(
+            snapshot._positions, snapshot._colors, snapshot._particleCount, _particleStyle);
     }
 
     // Refresh box mesh if bounds changed
-    const SPHConfig& config = sph.config();
+    const SPHConfig config = simulation.config();
     if (const auto diff = config.bounds - _boxHalfSize;
         std::abs(diff[0]) > 1e-4f || std::abs(diff[1]) > 1e-4f || std::abs(diff[2]) > 1e-4f) {
         _boxMesh = MeshFactory::createBox(config.bounds);
@@ -151,3 +240,13 @@ void Renderer::draw()
     glUniformMatrix4fv(glGetUniformLocation(_boxShaderProgram, "uView"), 1, GL_FALSE, view);
     _boxMesh.draw();
 }
+
+void Renderer::setParticleStyle(const ParticleStyle style)
+{
+    _particleStyle = style;
+}
+
+ParticleStyle Renderer::particleStyle() const
+{
+    return _particleStyle;
+}
@@ -1,10 +1,13 @@
 #include "../include/UI/Camera.h"
 #include "../include/UI/Renderer.h"
 #include "../include/UI/Window.h"
+#include "Simulation.h"
+#include "Tracer.h"
 #include <GLFW/glfw3.h>
 
 int main()
 {
+    Tracer::setThreadName("Render");
     Window& window = Window::getInstance();
     window.init(900, 900, "Particle Simulator");
 
@@ -13,6 +16,9 @@ int main()
         return -1;
     }
 
+    Simulation& simulation = Simulation::getInstance();
+    simulation.start();
+
     float deltaTime = 0.0f;
     float lastFrame = 0.0f;
 
@@ -25,14 +31,26 @@ int main()
 
         Window::pollEvents();
 
-        Window::beginImGuiFrame();
-        Window::configureImGui();
-
-        renderer.draw();
-
-        Window::renderImGui();
-        window.swapBuffers();
+        {
+            const TraceScope trace("configureImGui", "render");
+            Window::beginImGuiFrame();
+            Window::configureImGui();
+        }
+        {
+            const TraceScope trace("draw", "render");
+            renderer.draw();
+        }
+        {
+            const TraceScope trace("renderImGui", "render");
+            Window::renderImGui();
+        }
+        {
+            const TraceScope trace("swapBuffers", "render");
+            window.swapBuffers();
+        }
     }
 
+    simulation.stop();
+    Tracer::getInstance().stop();
     return 0;
 }
@@ -0,0 +1,371 @@
+#include "Math/SPH.h"
+#include "Rules.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Per-phase benchmark of the SPH step. Every combination of scene, particle count and thread
+// count is initialized fresh, warmed up with full steps, and then each phase is timed in
+// isolation, followed by the full step. Results are written as CSV, one row per phase. At least
+// one warm-up step always runs, since the phases rely on the neighbor search it builds. With
+// --counters, hardware counters are sampled around every phase on Linux, and each row also gets
+// the IPC and the LLC and branch misses per particle; these columns stay empty when the counters
+// are unavailable. --solver picks the state equation (the default), the implicit pressure solver
+// or position based fluids; the solvePressure row is empty for the state equation. With --fused,
+// pressure and viscosity share one neighbor pass, which the calculatePressureForce row times.
+// --simd caps the instruction set of the density and pressure kernels (the widest the CPU has by
+// default); the one actually used is reported on stderr. --kernel picks the shape of the density
+// kernel; only the spiky one has vector kernels, the others always run scalar. --dimensions 2
+// runs every scene flattened onto the z = 0 plane, with its lattices laid out in 2D.
+//
+//   sph_bench [--counts 10000,100000,1000000,4000000] [--threads 1,8] [--scenes pool,dam,random]
+//             [--iterations 5] [--warmup 2] [--lists] [--pairs] [--fused] [--counters]
+//             [--solver state|implicit|pbf] [--simd scalar|sse4|avx2|avx512]
+//             [--kernel spiky|poly6|cubic|wendland] [--dimensions 2|3] [--output results.csv]
+
+namespace {
+// Every phase in step order, then the full step.
+constexpr std::array PHASES {
+    SPHPhase::ExternalForces,
+    SPHPhase::SpatialHash,
+    SPHPhase::Offsets,
+    SPHPhase::Reorder,
+    SPHPhase::NeighborLists,
+    SPHPhase::Densities,
+    SPHPhase::PressureSolve,
+    SPHPhase::PressureForce,
+    SPHPhase::Viscosity,
+    SPHPhase::UpdatePositions,
+    SPHPhase::Step,
+};
+
+constexpr std::array SCENES { "pool", "dam", "random" };
+
+// Solver names for --solver, in PressureSolver order.
+constexpr std::array<std::string_view, 3> SOLVERS { "state", "implicit", "pbf" };
+
+// Instruction set names for --simd, in SimdLevel order.
+constexpr std::array<std::string_view, 4> SIMD_LEVELS { "scalar", "sse4", "avx2", "avx512" };
+
+// Kernel names for --kernel, in SmoothingKernel order.
+constexpr std::array<std::string_view, 4> KERNELS { "spiky", "poly6", "cubic", "wendland" };
+
+// Particle count the solver's default config is tuned for (the GUI scene).
+constexpr float REFERENCE_COUNT = 10000.0f;
+
+// Extent of every scene along z, which 2D runs flatten onto the plane.
+constexpr float SCENE_DEPTH = 1.9f;
+
+struct Options {
+    std::vector<size_t> _counts { 10000, 100000, 1000000, 4000000 };
+    std::vector<size_t> _threads;
+    std::vector<std::string> _scenes { SCENES.begin(), SCENES.end() };
+    size_t _iterations = 5;
+    size_t _warmup = 2;
+    bool _neighborLists = false;
+    bool _symmetricPairs = false;
+    bool _fusedForces = false;
+    bool _counters = false;
+    PressureSolver _solver = PressureSolver::StateEquation;
+    SimdLevel _simdLevel = SimdLevel::AVX512;
+    SmoothingKernel _kernel = SmoothingKernel::Spiky;
+    int _dimensions = 3;
+    std::string _output;
+};
+
+bool parseCount(const std::string_view text, size_t& value)
+{
+    const std::string copy(text);
+    char* end = nullptr;
+    const unsigned long long parsed = std::strtoull(copy.c_str(), &end, 10);
+    if (copy.empty() || *end != '\0')
+        return false;
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+
+std::vector<std::string> splitList(const std::string_view text)
+{
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        const size_t comma = std::min(text.find(',', begin), text.size());
+        items.emplace_back(text.substr(begin, comma - begin));
+        begin = comma + 1;
+    }
+    return items;
+}
+
+bool parseCounts(const std::string_view text, std::vector<size_t>& values)
+{
+    values.clear();
+    for (const std::string& item : splitList(text)) {
+        size_t value = 0;
+        if (!parseCount(item, value))
+            return false;
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+bool parseOptions(const int argc, char** argv, Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--lists") {
+            options._neighborLists = true;
+        } else if (arg == "--pairs") {
+            options._symmetricPairs = true;
+        } else if (arg == "--fused") {
+            options._fusedForces = true;
+        } else if (arg == "--counters") {
+            options._counters = true;
+        } else if (!hasValue) {
+            return false;
+        } else if (arg == "--counts") {
+            if (!parseCounts(argv[++i], options._counts))
+                return false;
+        } else if (arg == "--threads") {
+            if (!parseCounts(argv[++i], options._threads))
+                return false;
+        } else if (arg == "--scenes") {
+            options._scenes = splitList(argv[++i]);
+            for (const std::string& scene : options._scenes) {
+                if (std::ranges::find(SCENES, scene) == SCENES.end())
+                    return false;
+            }
+        } else if (arg == "--iterations") {
+            if (!parseCount(argv[++i], options._iterations) || options._iterations == 0)
+                return false;
+        } else if (arg == "--warmup") {
+            if (!parseCount(argv[++i], options._warmup))
+                return false;
+        } else if (arg == "--solver") {
+            const std::string_view solver = argv[++i];
+            const auto found = std::ranges::find(SOLVERS, solver);
+            if (found == SOLVERS.end())
+                return false;
+            options._solver = static_cast<PressureSolver>(found - SOLVERS.begin());
+        } else if (arg == "--simd") {
+            const std::string_view level = argv[++i];
+            const auto found = std::ranges::find(SIMD_LEVELS, level);
+            if (found == SIMD_LEVELS.end())
+                return false;
+            options._simdLevel = static_cast<SimdLevel>(found - SIMD_LEVELS.begin());
+        } else if (arg == "--kernel") {
+            const std::string_view kernel = argv[++i];
+            const auto found = std::ranges::find(KERNELS, kernel);
+            if (found == KERNELS.end())
+                return false;
+            options._kernel = static_cast<SmoothingKernel>(found - KERNELS.begin());
+        } else if (arg == "--dimensions") {
+            const std::string_view dimensions = argv[++i];
+            if (dimensions != "2" && dimensions != "3")
+                return false;
+            options._dimensions = dimensions == "2" ? 2 : 3;
+        } else if (arg == "--output") {
+            options._output = argv[++i];
+        } else {
+            return false;
+        }
+    }
+
+    if (options._threads.empty()) {
+        const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+        options._threads = { 1 };
+        if (hardware > 1)
+            options._threads.push_back(hardware);
+    }
+    return true;
+}
+
+// Particles on a regular lattice filling the box from the bottom up, at rest. In 2D the lattice
+// is a single layer at the box's minimum z.
+std::vector<Particle> latticeInBox(
+    const size_t count, const Vec3<float>& min, const Vec3<float>& max, const int dimensions)
+{
+    const Vec3<float> size = max - min;
+    const float volume = size[0] * size[1] * (dimensions == 2 ? 1.0f : size[2]);
+    float spacing
+        = std::pow(volume / static_cast<float>(count), 1.0f / static_cast<float>(dimensions));
+    auto pointsAlong = [&spacing](const float length) {
+        return static_cast<size_t>(length / spacing) + 1;
+    };
+    auto layerPoints = [&]() { return dimensions == 2 ? size_t { 1 } : pointsAlong(size[2]); };
+    while (pointsAlong(size[0]) * pointsAlong(size[1]) * layerPoints() < count)
+        spacing *= 0.99f;
+
+    std::vector<Particle> particles;
+    particles.reserve(count);
+    const size_t nx = pointsAlong(size[0]);
+    const size_t nz = layerPoints();
+    for (size_t i = 0; particles.size() < count; ++i) {
+        const size_t x = i % nx;
+        const size_t z = i / nx % nz;
+        const size_t y = i / (nx * nz);
+        const Vec3<float> offset { static_cast<float>(x), static_cast<float>(y),
+            static_cast<float>(z) };
+        particles.emplace_back(min + offset * spacing, Vec3<float> { 0.0f, 0.0f, 0.0f });
+    }
+    return particles;
+}
+
+std::vector<Particle> createScene(
+    const std::string& scene, const size_t count, const int dimensions)
+{
+    // A pool resting on the floor, a water column in one corner about to collapse, and particles
+    // scattered uniformly through the whole box. init flattens 2D scenes onto z = 0.
+    if (scene == "pool")
+        return latticeInBox(
+            count, { -0.95f, -0.95f, -0.95f }, { 0.95f, -0.15f, 0.95f }, dimensions);
+    if (scene == "dam")
+        return latticeInBox(
+            count, { -0.95f, -0.95f, -0.95f }, { -0.15f, 0.75f, 0.95f }, dimensions);
+    return spawnParticlesInBox(count, 2.0f, 0.05f, -1.0f);
+}
+
+SPHConfig createConfig(const size_t count, const Options& options)
+{
+    // Keep the neighbor count of the reference scene at every size by shrinking the smoothing
+    // radius with the particle spacing. The time step is fixed, so forces are scaled to move
+    // particles the same fraction of the smoothing radius per step as in the reference scene;
+    // otherwise larger scenes break the time step limit and blow up. In 2D the reference is the
+    // 3D one flattened to the same neighbor count.
+    SPHConfig config;
+    if (options._dimensions == 2)
+        config = planarConfig(config, SCENE_DEPTH);
+    const float scale = std::pow(REFERENCE_COUNT / static_cast<float>(std::max<size_t>(count, 1)),
+        1.0f / static_cast<float>(options._dimensions));
+    config.smoothingRadius *= scale;
+    config.neighborSkin *= scale;
+    config.gravity *= scale;
+    config.pressureMultiplier *= scale * scale;
+    config.nearPressureMultiplier *= scale * scale;
+    config.viscosityStrength *= scale * scale * scale;
+    config.neighborLists = options._neighborLists;
+    config.symmetricPairs = options._symmetricPairs;
+    config.fusedForces = options._fusedForces;
+    config.hardwareCounters = options._counters;
+    config.pressureSolver = options._solver;
+    config.simdLevel = options._simdLevel;
+    config.smoothingKernel = options._kernel;
+
+    // Rest at the density of the pool lattice, so the pool starts out settled instead of
+    // exploding or collapsing, and the other scenes move the way they would in the viewer.
+    config.targetDensity = restDensity(config, createScene("pool", count, options._dimensions));
+    return config;
+}
+
+// Add up the counters of a phase over every thread of the last runPhase call, or of every phase
+// for the full step.
+bool addCounters(const SPH& sph, const SPHPhase phase, CounterValues& total)
+{
+    bool counted = true;
+    for (const PhaseTimes& times : sph.phaseTimes()) {
+        counted &= times._counted;
+        for (size_t index = 0; index < PHASE_COUNT; ++index) {
+            if (phase == SPHPhase::Step || index == static_cast<size_t>(phase))
+                total += times._counters[index];
+        }
+    }
+    return counted;
+}
+
+// Write the IPC and the LLC and branch misses per particle and iteration, or empty columns.
+void writeCounters(std::ostream& out, const CounterValues& counters, const bool counted,
+    const size_t particles, const size_t iterations)
+{
+    if (!counted) {
+        out << ",,,";
+        return;
+    }
+    const double ipc = counters._cycles
+        ? static_cast<double>(counters._instructions) / static_cast<double>(counters._cycles)
+        : 0.0;
+    const double samples = static_cast<double>(std::max<size_t>(particles * iterations, 1));
+    out << ',' << ipc << ',' << static_cast<double>(counters._cacheMisses) / samples << ','
+        << static_cast<double>(counters._branchMisses) / samples;
+}
+} // namespace
+
+int main(const int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--counts N,...] [--threads N,...] [--scenes pool,dam,random]"
+                     " [--iterations N] [--warmup N] [--lists] [--pairs] [--fused] [--counters]"
+                     " [--solver state|implicit|pbf] [--simd scalar|sse4|avx2|avx512]"
+                     " [--kernel spiky|poly6|cubic|wendland] [--dimensions 2|3] [--output FILE]\n";
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!options._output.empty()) {
+        file.open(options._output);
+        if (!file) {
+            std::cerr << "Failed to open " << options._output << '\n';
+            return 1;
+        }
+    }
+    std::ostream& out = options._output.empty() ? std::cout : file;
+    out << "scene,particles,threads,phase,iterations,mean_ms,min_ms,max_ms,ipc,"
+           "llc_misses_per_particle,branch_misses_per_particle\n";
+
+    SPH& sph = SPH::getInstance();
+    for (const size_t count : options._counts) {
+        const SPHConfig config = createConfig(count, options);
+        std::cerr << "Neighbor kernels: " << simdLevelName(sph.simdLevel()) << '\n';
+        for (const std::string& scene : options._scenes) {
+            const std::vector<Particle> particles = createScene(scene, count, options._dimensions);
+
+            for (const size_t threads : options._threads) {
+                std::cerr << scene << ", " << count << " particles, " << threads << " threads\n";
+                for (const SPHPhase phase : PHASES) {
+                    // Start every phase from the same warmed-up state, since most of them
+                    // change the particles they run on.
+                    sph.init(config, particles, threads);
+                    for (size_t step = 0; step < std::max<size_t>(options._warmup, 1); ++step)
+                        sph.step();
+
+                    double total = 0.0;
+                    double fastest = 0.0;
+                    double slowest = 0.0;
+                    CounterValues counters;
+                    bool counted = options._counters;
+                    for (size_t iteration = 0; iteration < options._iterations; ++iteration) {
+                        const auto phaseStart = std::chrono::steady_clock::now();
+                        sph.runPhase(phase);
+                        const auto phaseEnd = std::chrono::steady_clock::now();
+                        const double ms
+                            = std::chrono::duration<double, std::milli>(phaseEnd - phaseStart)
+                                  .count();
+                        total += ms;
+                        fastest = iteration == 0 ? ms : std::min(fastest, ms);
+                        slowest = std::max(slowest, ms);
+                        counted &= addCounters(sph, phase, counters);
+                    }
+
+                    out << scene << ',' << sph.particles().size() << ',' << sph.threadCount()
+                        << ',' << phaseName(phase) << ',' << options._iterations << ','
+                        << total / static_cast<double>(options._iterations) << ',' << fastest
+                        << ',' << slowest;
+                    writeCounters(
+                        out, counters, counted, sph.particles().size(), options._iterations);
+                    out << '\n';
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "AllocationAudit.h"
+#include "Math/SPH.h"
+#include "Rules.h"
+#include "Tracer.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace {
+// Solver names for --solver, in PressureSolver order.
+constexpr std::array<std::string_view, 3> SOLVERS { "state", "implicit", "pbf" };
+
+// Particle order names for --order, in ParticleOrder order.
+constexpr std::array<std::string_view, 3> ORDERS { "cellkey", "morton", "hilbert" };
+
+// Grid names for --grid, in NeighborGrid order.
+constexpr std::array<std::string_view, 2> GRIDS { "hashed", "dense" };
+
+// Box the particles spawn in, the same as the GUI scene's.
+constexpr float BOX_SIZE = 2.0f;
+constexpr float SPAWN_MARGIN = 0.05f;
+
+// Index of a name in a table, or the table's size when it is not there.
+template <size_t N> size_t findName(const std::array<std::string_view, N>& names, const char* name)
+{
+    return static_cast<size_t>(std::ranges::find(names, std::string_view(name)) - names.begin());
+}
+
+bool parseCount(const char* text, size_t& value)
+{
+    char* end = nullptr;
+    const unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (end == text || *end != '\0')
+        return false;
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+} // namespace
+
+// Headless solver run for machines without a display:
+//   sph_run <particles> <steps> [threads] [--solver state|implicit|pbf] [--dimensions 2|3]
+//           [--order cellkey|morton|hilbert] [--grid dense|hashed] [--lists] [--pairs]
+//           [--fused] [--adaptive] [--trace trace.json] [--audit-allocations]
+//           [--check-convergence]
+// Particles start in the same box as the GUI scene, with SPHConfig's defaults and the target
+// density they rest at (see restDensity); a thread count of 0 uses every hardware thread. The
+// other options override those defaults: --solver picks the pressure solver, --dimensions 2
+// flattens the scene onto the z = 0 plane with the smoothing radius that keeps its neighbor count
+// (see planarConfig), --order and --grid pick the particle order and neighbor grid, --lists,
+// --pairs and --fused turn on neighbor lists, symmetric pairs and the fused force pass, and
+// --adaptive splits frames into substeps.
+// With --trace, every worker's phases and barrier waits are written as a Chrome trace. With
+// --audit-allocations, in a build configured with NES_ALLOCATION_AUDIT, any heap allocation inside
+// a step after the first aborts the run. With --check-convergence, the run fails if the implicit
+// solver ends any step after the first at maxPressureIterations or above densityTolerance; the
+// first step starts from the random spawn, whose overlapping particles no single solve separates.
+// The run always fails if any particle ends up at a non-finite position.
+int main(const int argc, char** argv)
+{
+    // Options may come before, between or after the counts.
+    SPHConfig config;
+    const char* tracePath = nullptr;
+    bool auditAllocations = false;
+    bool checkConvergence = false;
+    std::array<size_t, 3> counts { 0, 0, 0 };
+    size_t countsGiven = 0;
+    bool valid = true;
+    for (int i = 1; i < argc && valid; ++i) {
+        const std::string_view arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--audit-allocations") {
+            auditAllocations = true;
+        } else if (arg == "--check-convergence") {
+            checkConvergence = true;
+        } else if (arg == "--lists") {
+            config.neighborLists = true;
+        } else if (arg == "--pairs") {
+            config.symmetricPairs = true;
+        } else if (arg == "--fused") {
+            config.fusedForces = true;
+        } else if (arg == "--adaptive") {
+            config.adaptiveTimestep = true;
+        } else if (arg == "--trace" && hasValue) {
+            tracePath = argv[++i];
+        } else if (arg == "--solver" && hasValue) {
+            const size_t found = findName(SOLVERS, argv[++i]);
+            valid = found < SOLVERS.size();
+            config.pressureSolver = static_cast<PressureSolver>(found);
+        } else if (arg == "--order" && hasValue) {
+            const size_t found = findName(ORDERS, argv[++i]);
+            valid = found < ORDERS.size();
+            config.particleOrder = static_cast<ParticleOrder>(found);
+        } else if (arg == "--grid" && hasValue) {
+            const size_t found = findName(GRIDS, argv[++i]);
+            valid = found < GRIDS.size();
+            config.neighborGrid = static_cast<NeighborGrid>(found);
+        } else if (arg == "--dimensions" && hasValue) {
+            const std::string_view dimensions = argv[++i];
+            valid = dimensions == "2" || dimensions == "3";
+            config.dimensions = dimensions == "2" ? 2 : 3;
+        } else {
+            valid = countsGiven < counts.size() && parseCount(argv[i], counts[countsGiven++]);
+        }
+    }
+
+    const auto [particleCount, steps, threads] = counts;
+    if (!valid || countsGiven < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " <particles> <steps> [threads] [--solver state|implicit|pbf]"
+                     " [--dimensions 2|3] [--order cellkey|morton|hilbert] [--grid dense|hashed]"
+                     " [--lists] [--pairs] [--fused] [--adaptive] [--trace FILE]"
+                     " [--audit-allocations] [--check-convergence]\n";
+        return 1;
+    }
+    if (auditAllocations && !AllocationAudit::available()) {
+        std::cerr << "--audit-allocations needs a build configured with NES_ALLOCATION_AUDIT\n";
+        return 1;
+    }
+
+    // Measured before tracing starts, so the trace only holds the run's own steps.
+    if (config.dimensions == 2)
+        config = planarConfig(config, BOX_SIZE - 2.0f * SPAWN_MARGIN);
+    const std::vector<Particle> particles
+        = spawnParticlesInBox(particleCount, BOX_SIZE, SPAWN_MARGIN, 0.5f);
+    config.targetDensity = restDensity(config, particles);
+    if (tracePath && !Tracer::getInstance().start(tracePath)) {
+        std::cerr << "Failed to open " << tracePath << '\n';
+        return 1;
+    }
+    Tracer::setThreadName("sph_run");
+
+    SPH& sph = SPH::getInstance();
+    sph.init(config, particles, threads);
+
+    float slowestStep = 0.0f;
+    size_t unconverged = 0;
+    const auto runStart = std::chrono::steady_clock::now();
+    for (size_t step = 0; step < steps; ++step) {
+        // The first step is the warm-up that sizes the buffers init could not.
+        if (auditAllocations && step == 1)
+            AllocationAudit::getInstance().arm(true);
+        sph.step();
+        slowestStep = std::max(slowestStep, sph.stepTime());
+        if (step > 0 && config.pressureSolver == PressureSolver::Implicit
+            && (sph.pressureIterations() >= config.maxPressureIterations
+                || sph.densityError() > config.densityTolerance))
+            ++unconverged;
+    }
+    const auto runEnd = std::chrono::steady_clock::now();
+    AllocationAudit::getInstance().arm(false);
+    Tracer::getInstance().stop();
+    const double totalMs = std::chrono::duration<double, std::milli>(runEnd - runStart).count();
+
+    std::cout << "particles: " << sph.particles().size() << '\n'
+              << "threads: " << sph.threadCount() << '\n'
+              << "steps: " << steps << '\n'
+              << "total: " << totalMs << " ms\n";
+    if (steps > 0) {
+        std::cout << "mean step: " << totalMs / static_cast<double>(steps) << " ms\n"
+                  << "slowest step: " << slowestStep << " ms\n"
+                  << "steps/s: " << static_cast<double>(steps) * 1000.0 / totalMs << '\n';
+    }
+    if (auditAllocations) {
+        std::cout << "allocations in steps: " << AllocationAudit::getInstance().allocations()
+                  << '\n';
+    }
+    if (config.pressureSolver == PressureSolver::Implicit)
+        std::cout << "unconverged steps: " << unconverged << '\n';
+
+    const ParticleView view = sph.particles();
+    size_t nonFinite = 0;
+    for (size_t i = 0; i < view.size(); ++i) {
+        const Vec3<float> position = view.position(i);
+        if (!std::isfinite(position[0]) || !std::isfinite(position[1])
+            || !std::isfinite(position[2]))
+            ++nonFinite;
+    }
+    if (nonFinite > 0) {
+        std::cerr << nonFinite << " particles at non-finite positions\n";
+        return 1;
+    }
+    if (checkConvergence && unconverged > 0) {
+        std::cerr << "The implicit solver stopped short of densityTolerance in " << unconverged
+                  << " steps\n";
+        return 1;
+    }
+    return 0;
+}
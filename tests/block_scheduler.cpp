@@ -0,0 +1,86 @@
+#include "Math/BlockScheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Stress test for the work-stealing BlockScheduler. Threads drain ranges of many sizes and block
+// sizes while the first thread stalls after its first block, so the others must steal the rest of
+// its run while still racing each other as owners and thieves. Every item must be handed out
+// exactly once.
+
+namespace {
+constexpr int ROUNDS = 20;
+
+// Drain one reset of the scheduler. Returns the number of items not handed out exactly once.
+size_t drain(BlockScheduler& scheduler, const size_t threadCount, const size_t itemCount,
+    const size_t blockSize, size_t& stalledBlocks)
+{
+    scheduler.reset(itemCount, blockSize);
+    const auto taken = std::make_unique<std::atomic<uint32_t>[]>(itemCount);
+    std::atomic<size_t> finished { 0 };
+    std::vector<size_t> blocksTaken(threadCount, 0);
+
+    auto work = [&](const size_t thread) {
+        size_t start = 0;
+        size_t end = 0;
+        while (scheduler.next(thread, start, end)) {
+            for (size_t item = start; item < end; ++item)
+                taken[item].fetch_add(1, std::memory_order_relaxed);
+            ++blocksTaken[thread];
+            // The stalled thread waits until the others have run out of blocks.
+            if (thread == 0) {
+                while (finished.load(std::memory_order_acquire) < threadCount - 1)
+                    std::this_thread::yield();
+            }
+        }
+        if (thread != 0)
+            finished.fetch_add(1, std::memory_order_release);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t thread = 1; thread < threadCount; ++thread)
+        threads.emplace_back(work, thread);
+    work(0);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    stalledBlocks = blocksTaken[0];
+    size_t wrong = 0;
+    for (size_t item = 0; item < itemCount; ++item)
+        wrong += taken[item].load(std::memory_order_relaxed) != 1;
+    return wrong;
+}
+} // namespace
+
+int main()
+{
+    int failures = 0;
+    BlockScheduler scheduler;
+    for (const size_t threadCount : { 2, 3, 4, 8 }) {
+        scheduler.init(threadCount);
+        for (const size_t itemCount : { 0, 1, 7, 1000, 4097, 100003 }) {
+            for (const size_t blockSize : { 1, 3, 64, 1000 }) {
+                size_t wrong = 0;
+                size_t stalledBlocks = 0;
+                for (int round = 0; round < ROUNDS; ++round) {
+                    size_t blocks = 0;
+                    wrong += drain(scheduler, threadCount, itemCount, blockSize, blocks);
+                    stalledBlocks = std::max(stalledBlocks, blocks);
+                }
+                // The stalled thread takes one block at most; the rest of its run is stolen.
+                const bool stolen = stalledBlocks <= 1;
+                if (wrong > 0 || !stolen) {
+                    std::cout << threadCount << " threads, " << itemCount << " items in blocks of "
+                              << blockSize << ": " << wrong << " items not taken exactly once, "
+                              << stalledBlocks << " blocks taken by the stalled thread\n";
+                    ++failures;
+                }
+            }
+        }
+    }
+    std::cout << (failures == 0 ? "Every item was taken exactly once\n" : "FAILED\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#include "Math/SPH.h"
+#include "Rules.h"
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Checks that every vector kernel this CPU supports steps the particles to exactly the positions
+// the scalar loops do. The kernels add neighbors in the same order with the same operations, so
+// any difference, however small, means one of them no longer matches the scalar path.
+
+namespace {
+constexpr size_t PARTICLES = 3000;
+constexpr size_t STEPS = 5;
+constexpr unsigned SEED = 1;
+
+// Positions of every particle after the steps, x, y and z back to back.
+std::vector<float> run(SPHConfig config, const std::vector<Particle>& particles,
+    const size_t threads, SimdLevel& used)
+{
+    SPH& sph = SPH::getInstance();
+    sph.init(config, particles, threads);
+    for (size_t step = 0; step < STEPS; ++step)
+        sph.step();
+    used = sph.simdLevel();
+
+    const ParticleView view = sph.particles();
+    std::vector<float> positions;
+    positions.reserve(view.size() * 3);
+    for (size_t i = 0; i < view.size(); ++i) {
+        const Vec3<float> position = view.position(i);
+        positions.insert(positions.end(), { position[0], position[1], position[2] });
+    }
+    return positions;
+}
+} // namespace
+
+int main()
+{
+    const SimdLevel widest = detectSimdLevel();
+    std::cout << "Widest neighbor kernels: " << simdLevelName(widest) << '\n';
+
+    struct Scene {
+        const char* _name;
+        NeighborGrid _grid;
+        int _dimensions;
+    };
+    const Scene scenes[] = { { "dense", NeighborGrid::Dense, 3 },
+        { "hashed", NeighborGrid::Hashed, 3 }, { "2D", NeighborGrid::Dense, 2 } };
+
+    int failures = 0;
+    const std::vector<Particle> particles = spawnParticlesInBox(PARTICLES, 2.0f, 0.05f, 0.5f, SEED);
+    for (const Scene& scene : scenes) {
+        SPHConfig config;
+        config.neighborGrid = scene._grid;
+        config.dimensions = scene._dimensions;
+        config.targetDensity = restDensity(config, particles);
+
+        for (const size_t threads : { 1, 4 }) {
+            SimdLevel used = SimdLevel::Scalar;
+            config.simdLevel = SimdLevel::Scalar;
+            const std::vector<float> expected = run(config, particles, threads, used);
+
+            for (int level = 1; level <= static_cast<int>(widest); ++level) {
+                config.simdLevel = static_cast<SimdLevel>(level);
+                const std::vector<float> positions = run(config, particles, threads, used);
+                const bool ran = used == config.simdLevel;
+                const bool same = positions.size() == expected.size()
+                    && std::memcmp(positions.data(), expected.data(),
+                           positions.size() * sizeof(float))
+                        == 0;
+                std::cout << scene._name << ", " << threads << " threads, "
+                          << simdLevelName(config.simdLevel) << ": "
+                          << (!ran ? "not used" : same ? "identical" : "DIFFERENT") << '\n';
+                failures += !ran || !same;
+            }
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
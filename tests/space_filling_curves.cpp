@@ -0,0 +1,60 @@
+#include "Math/SpaceFillingCurves.h"
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Checks that the Morton and Hilbert curves number every cell of small 2D and 3D grids exactly
+// once, and that consecutive Hilbert indices are neighboring cells.
+
+namespace {
+using Curve = uint32_t (*)(const Vec3<int>&, uint32_t, int);
+
+// Failures found on a 2^bits grid in `dimensions` axes: indices out of range or repeated, which
+// leaves others unused, and for the Hilbert curve, steps between cells that do not share a face.
+int checkGrid(const char* name, const Curve curve, const uint32_t bits, const int dimensions,
+    const bool adjacent)
+{
+    const int side = 1 << bits;
+    const size_t cellCount = size_t { 1 } << (static_cast<uint32_t>(dimensions) * bits);
+    std::vector<Vec3<int>> cells(cellCount);
+    std::vector<bool> seen(cellCount, false);
+    int failures = 0;
+
+    for (int z = 0; z < (dimensions == 3 ? side : 1); ++z) {
+        for (int y = 0; y < side; ++y) {
+            for (int x = 0; x < side; ++x) {
+                const uint32_t index = curve({ x, y, z }, bits, dimensions);
+                if (index >= cellCount || seen[index]) {
+                    ++failures;
+                    continue;
+                }
+                seen[index] = true;
+                cells[index] = { x, y, z };
+            }
+        }
+    }
+
+    if (adjacent && failures == 0) {
+        for (size_t index = 1; index < cellCount; ++index) {
+            const Vec3<int> step = cells[index] - cells[index - 1];
+            failures += std::abs(step[0]) + std::abs(step[1]) + std::abs(step[2]) != 1;
+        }
+    }
+
+    std::cout << name << ' ' << dimensions << "D, " << bits << " bits: "
+              << (failures == 0 ? "ok" : "FAILED") << '\n';
+    return failures;
+}
+} // namespace
+
+int main()
+{
+    int failures = 0;
+    for (uint32_t bits = 1; bits <= 5; ++bits) {
+        for (const int dimensions : { 2, 3 }) {
+            failures += checkGrid("Morton", mortonIndex, bits, dimensions, false) != 0;
+            failures += checkGrid("Hilbert", hilbertIndex, bits, dimensions, true) != 0;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include "Math/SPH.h"
+#include "Rules.h"
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Checks that the parallel radix sort steps the particles exactly as the counting sort does. One
+// thread sorts with SPH::buildSpatialHash, more with SPH::sortSpatialHash and its exclusiveScan,
+// and both are stable, so every thread count must store the particles in the same order and
+// move them to the same places. The scenes give key counts of one and two radix passes, and
+// counts that are and are not powers of two.
+
+namespace {
+constexpr size_t STEPS = 3;
+constexpr unsigned SEED = 2;
+
+// Positions and velocities of every particle in storage order, after the steps.
+std::vector<float> run(const SPHConfig& config, const std::vector<Particle>& particles,
+    const size_t threads)
+{
+    SPH& sph = SPH::getInstance();
+    sph.init(config, particles, threads);
+    for (size_t step = 0; step < STEPS; ++step)
+        sph.step();
+
+    const ParticleView view = sph.particles();
+    std::vector<float> state;
+    state.reserve(view.size() * 6);
+    for (size_t i = 0; i < view.size(); ++i) {
+        const Vec3<float> position = view.position(i);
+        const Vec3<float> velocity = view.velocity(i);
+        state.insert(state.end(),
+            { position[0], position[1], position[2], velocity[0], velocity[1], velocity[2] });
+    }
+    return state;
+}
+} // namespace
+
+int main()
+{
+    struct Scene {
+        const char* _name;
+        size_t _particles;
+        NeighborGrid _grid;
+        ParticleOrder _order;
+        int _dimensions;
+        Vec3<float> _bounds;
+    };
+    // Hashed keys run up to the particle count; dense ones up to the cell count, or the curve's
+    // power-of-two cube.
+    const Scene scenes[] = {
+        { "hashed, 1500 keys", 1500, NeighborGrid::Hashed, ParticleOrder::CellKey, 3, { 1, 1, 1 } },
+        { "hashed, 3001 keys", 3001, NeighborGrid::Hashed, ParticleOrder::CellKey, 3, { 1, 1, 1 } },
+        { "hashed, 2048 keys", 2048, NeighborGrid::Hashed, ParticleOrder::CellKey, 3, { 1, 1, 1 } },
+        { "dense, uneven box", 3000, NeighborGrid::Dense, ParticleOrder::CellKey, 3,
+            { 1.3f, 0.9f, 0.7f } },
+        { "dense, Morton", 3000, NeighborGrid::Dense, ParticleOrder::Morton, 3,
+            { 1.3f, 0.9f, 0.7f } },
+        { "dense, Hilbert", 3000, NeighborGrid::Dense, ParticleOrder::Hilbert, 3,
+            { 1.3f, 0.9f, 0.7f } },
+        { "dense, 2D", 3000, NeighborGrid::Dense, ParticleOrder::CellKey, 2,
+            { 1.3f, 0.9f, 0.7f } },
+        { "hashed, 2D Hilbert", 3001, NeighborGrid::Hashed, ParticleOrder::Hilbert, 2,
+            { 1, 1, 1 } },
+    };
+
+    int failures = 0;
+    for (const Scene& scene : scenes) {
+        SPHConfig config;
+        config.neighborGrid = scene._grid;
+        config.particleOrder = scene._order;
+        config.dimensions = scene._dimensions;
+        config.bounds = scene._bounds;
+        const std::vector<Particle> particles
+            = spawnParticlesInBox(scene._particles, 2.0f, 0.05f, 0.5f, SEED);
+        config.targetDensity = restDensity(config, particles);
+
+        const std::vector<float> expected = run(config, particles, 1);
+        for (const size_t threads : { 2, 3, 5, 8 }) {
+            const std::vector<float> state = run(config, particles, threads);
+            const bool same = state.size() == expected.size()
+                && std::memcmp(state.data(), expected.data(), state.size() * sizeof(float)) == 0;
+            std::cout << scene._name << ", " << threads
+                      << " threads: " << (same ? "identical" : "DIFFERENT") << '\n';
+            failures += !same;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}